@@ -0,0 +1,112 @@
+﻿// AllocAudit.h : Counting the heap allocations made inside a search
+//
+// A search node should not allocate: a stray vector copy or string in the node
+// loop costs more than the node's own work. The searches open a Scope around
+// their node loops, and an allocation made on that thread while a scope is open
+// is counted against it, or with setAbort stops the program on the spot for a
+// debugger's stack trace. Work that may allocate now and then inside a search,
+// such as writing a checkpoint or publishing a solution, runs under a Pause.
+// The counting needs operator new to call record(), which AllocHooks.h arranges:
+// the solver includes it when built with -DRUBIKS_ALLOC_AUDIT=ON, the benchmark
+// binary always does, and record() also keeps a process-wide total for it.
+// Otherwise a scope costs two thread_local updates per search and counts nothing.
+
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+class AllocAudit {
+public:
+	/// <summary>
+	/// Allocations on this thread from construction on count against the scope
+	/// </summary>
+	class Scope {
+	public:
+		Scope() : _begin(state().allocations) {
+			++state().depth;
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope() {
+			--state().depth;
+		}
+
+		/// <summary>
+		/// Allocations made inside the scope so far
+		/// </summary>
+		uint64_t allocations() const {
+			return state().allocations - _begin;
+		}
+
+	private:
+		uint64_t _begin;
+	};
+
+	/// <summary>
+	/// Allocations on this thread are not audited until it is destroyed
+	/// </summary>
+	class Pause {
+	public:
+		Pause() : _depth(state().depth) {
+			state().depth = 0;
+		}
+
+		Pause(const Pause&) = delete;
+		Pause& operator=(const Pause&) = delete;
+
+		~Pause() {
+			state().depth = _depth;
+		}
+
+	private:
+		int _depth;
+	};
+
+	/// <summary>
+	/// Called by operator new for every allocation; must not allocate itself
+	/// </summary>
+	static void record() noexcept {
+		_total.fetch_add(1, std::memory_order_relaxed);
+		State& current = state();
+		if (current.depth > 0) {
+			++current.allocations;
+			if (_abort.load(std::memory_order_relaxed)) {
+				std::fputs("Heap allocation inside a search scope\n", stderr);
+				std::abort();
+			}
+		}
+	}
+
+	/// <summary>
+	/// Allocations recorded on all threads, inside scopes or not
+	/// </summary>
+	static uint64_t total() {
+		return _total.load(std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Abort on an allocation inside a scope instead of counting it, on every thread
+	/// </summary>
+	static void setAbort(bool abort) {
+		_abort.store(abort, std::memory_order_relaxed);
+	}
+
+private:
+	struct State {
+		int depth = 0;                          // Open scopes, 0 while paused
+		uint64_t allocations = 0;               // Made inside scopes on this thread
+	};
+
+	static inline std::atomic<bool> _abort{ false };
+	static inline std::atomic<uint64_t> _total{ 0 };
+
+	static State& state() {
+		thread_local State current;
+		return current;
+	}
+};
@@ -0,0 +1,116 @@
+﻿// AllocAuditTest.cpp : No heap allocation per node in the search loops
+//
+// Built with the allocation hooks, the dfs (plain and finishing from an endgame
+// table), the anytime two-phase solve that publishes each improvement, and the
+// plain two-phase solve run seeded scrambles in both metrics, and each solve must
+// report zero allocations inside its AllocAudit scopes. A deliberate allocation
+// inside a scope is checked first, so a hook that counts nothing cannot pass.
+
+#include "Cube.h"
+#include "TwoPhase.h"
+#include "Endgame.h"
+#include "Scramble.h"
+#include "AllocHooks.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace {
+
+	constexpr int ScrambleCount = 8;
+
+	/// <summary>
+	/// Standard output swallowed while alive, for the progress lines of the dfs
+	/// </summary>
+	class SilenceOutput {
+	public:
+		SilenceOutput() : _saved(std::cout.rdbuf(_null.rdbuf())) {
+		}
+
+		~SilenceOutput() {
+			std::cout.rdbuf(_saved);
+		}
+
+	private:
+		std::ostringstream _null;
+		std::streambuf* _saved;
+	};
+
+	bool check(bool condition, const std::string& message) {
+		if (!condition) {
+			std::cerr << "FAILED: " << message << std::endl;
+		}
+		return condition;
+	}
+
+	/// <summary>
+	/// Check a solve found its solution without allocating in its node loops
+	/// </summary>
+	bool checkSolve(const SolveResult& result, const std::string& name) {
+		bool good = check(result.status == SOLVED, name + ": not solved");
+		good = check(result.nodes > 0, name + ": no nodes searched") && good;
+		if (result.stats.allocations > 0) {
+			std::cerr << "FAILED: " << name << ": " << result.stats.allocations << " allocations in " << result.nodes << " nodes" << std::endl;
+			good = false;
+		}
+		return good;
+	}
+}
+
+int main() {
+	bool good = true;
+
+	uint64_t counted = 0;
+	{
+		AllocAudit::Scope scope;
+		// Through a volatile, or the compiler may drop an allocation nothing uses
+		void* volatile probe = ::operator new(sizeof(int));
+		::operator delete(probe);
+		counted = scope.allocations();
+	}
+	good = check(counted == 1, "an allocation inside a scope was not counted") && good;
+
+	EndgameTable endgame;
+	TwoPhaseSolver::instance();
+	for (Metric metric : { QUARTER_TURN, HALF_TURN }) {
+		const std::string name = metric == HALF_TURN ? "htm" : "qtm";
+		endgame.build(6, metric);
+		ScrambleGenerator generator(2024);
+		for (int i = 0; i < ScrambleCount; ++i) {
+			const Cube222::Facelets shortScramble = generator.randomScramble(5, metric);
+			const Cube222::Facelets longScramble = generator.randomScramble(14, metric);
+			SolveOptions options;
+			options.metric = metric;
+
+			{
+				Cube222 cube;
+				cube.setFacelets(shortScramble);
+				SilenceOutput silence;
+				good = checkSolve(cube.dfs(options), name + " dfs") && good;
+			}
+
+			{
+				SolveOptions endgameOptions = options;
+				endgameOptions.endgame = &endgame;
+				Cube222 cube;
+				cube.setFacelets(longScramble);
+				SilenceOutput silence;
+				good = checkSolve(cube.dfs(endgameOptions), name + " dfs+endgame") && good;
+			}
+
+			// The callback copies each improvement, which the search must not count against itself
+			std::vector<std::vector<Rotation>> improvements;
+			SolveResult anytime = TwoPhaseSolver::instance().solve(longScramble, options, [&](const SolveResult& improved) {
+				improvements.push_back(improved.solution);
+			});
+			good = checkSolve(anytime, name + " anytime") && good;
+			good = check(!improvements.empty(), name + " anytime: no improvement published") && good;
+
+			good = checkSolve(TwoPhaseSolver::instance().solve(longScramble, options), name + " two-phase") && good;
+		}
+	}
+
+	std::cout << (good ? "AllocAudit: all checks passed" : "AllocAudit: checks failed") << std::endl;
+	return good ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+﻿// AllocHooks.h : Global operator new and delete that report to AllocAudit
+//
+// AllocAudit only sees the allocations operator new tells it about. This header
+// replaces every form of the global operators, plain and array, sized, aligned
+// and nothrow, so that each allocation calls AllocAudit::record() once and each
+// block is freed the way it was allocated. Replacement operators must be defined
+// once per program: include this header in the one translation unit with main.
+
+#pragma once
+
+#include <new>
+#include <cstdlib>
+#include <cstddef>
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+#include "AllocAudit.h"
+
+// Kept out of line: with malloc and free inlined into the operators, and the operators into
+// their callers, GCC pairs new with free and warns of a mismatch (-Wmismatched-new-delete)
+#if defined(__GNUC__)
+#define ALLOC_HOOK_NOINLINE __attribute__((noinline))
+#else
+#define ALLOC_HOOK_NOINLINE
+#endif
+
+namespace AllocHooks {
+
+	ALLOC_HOOK_NOINLINE inline void* allocate(std::size_t size) noexcept {
+		AllocAudit::record();
+		return std::malloc(size == 0 ? 1 : size);
+	}
+
+	ALLOC_HOOK_NOINLINE inline void* allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+		AllocAudit::record();
+		const std::size_t align = static_cast<std::size_t>(alignment);
+		// aligned_alloc wants a size that is a multiple of the alignment
+		const std::size_t rounded = (size == 0 ? align : (size + align - 1) / align * align);
+#if defined(_MSC_VER)
+		return _aligned_malloc(rounded, align);
+#else
+		return std::aligned_alloc(align, rounded);
+#endif
+	}
+
+	ALLOC_HOOK_NOINLINE inline void release(void* block) noexcept {
+		std::free(block);
+	}
+
+	ALLOC_HOOK_NOINLINE inline void releaseAligned(void* block) noexcept {
+#if defined(_MSC_VER)
+		_aligned_free(block);
+#else
+		std::free(block);
+#endif
+	}
+}
+
+void* operator new(std::size_t size) {
+	if (void* block = AllocHooks::allocate(size)) {
+		return block;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	if (void* block = AllocHooks::allocate(size)) {
+		return block;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	return AllocHooks::allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return AllocHooks::allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	if (void* block = AllocHooks::allocateAligned(size, alignment)) {
+		return block;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	if (void* block = AllocHooks::allocateAligned(size, alignment)) {
+		return block;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return AllocHooks::allocateAligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	return AllocHooks::allocateAligned(size, alignment);
+}
+
+void operator delete(void* block) noexcept {
+	AllocHooks::release(block);
+}
+
+void operator delete[](void* block) noexcept {
+	AllocHooks::release(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+	AllocHooks::release(block);
+}
+
+void operator delete[](void* block, std::size_t) noexcept {
+	AllocHooks::release(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) noexcept {
+	AllocHooks::release(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) noexcept {
+	AllocHooks::release(block);
+}
+
+void operator delete(void* block, std::align_val_t) noexcept {
+	AllocHooks::releaseAligned(block);
+}
+
+void operator delete[](void* block, std::align_val_t) noexcept {
+	AllocHooks::releaseAligned(block);
+}
+
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept {
+	AllocHooks::releaseAligned(block);
+}
+
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept {
+	AllocHooks::releaseAligned(block);
+}
+
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+	AllocHooks::releaseAligned(block);
+}
+
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept {
+	AllocHooks::releaseAligned(block);
+}
@@ -0,0 +1,244 @@
+﻿// Cache.h : Solution cache keyed by symmetry class, with an optional append-only log
+//
+// Repeated queries (drills, retries) should not search again. A solution is
+// stored once per symmetry class, in the frame of the class representative, and
+// translated through the conjugating symmetry on the way out, so the 48
+// rotated and mirrored variants of a state share one entry. Finding the class
+// representative takes 48 conjugations, so each state seen is also indexed by
+// its plain encoding and a repeat query skips them. The entries live in an LRU
+// list; with a log file every new entry is also appended as a text line
+//   <representative> <qtm|htm> <move count> <moves...>
+// and the log is replayed when the cache is opened. A solution is verified on
+// the state before it is returned, so an entry a damaged log got wrong is
+// dropped instead of served.
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <iterator>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#include "Cube.h"
+#include "Symmetry.h"
+
+class SolutionCache {
+public:
+	using Facelets = Cube222::Facelets;
+
+	SolutionCache(size_t capacity = 1 << 16) : _capacity(capacity) {
+	}
+
+	/// <summary>
+	/// Replay a log into the cache, then append new entries to it
+	/// </summary>
+	/// <param name="path">Log file, created if missing</param>
+	/// <returns>False if the log cannot be written</returns>
+	bool open(const std::string& path) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::ifstream in(path);
+		std::string line;
+		while (std::getline(in, line)) {
+			// A torn last line from a crash fails to parse and is dropped
+			uint64_t key;
+			std::vector<Rotation> solution;
+			if (parseLine(line, key, solution)) {
+				insert(key, solution);
+			}
+		}
+
+		_log.open(path, std::ios::app);
+		if (!_log) {
+			std::cerr << "Cannot write cache log " << path << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Cached solution of a state
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme with the DBL corner fixed</param>
+	/// <param name="metric">Metric the solution was found in</param>
+	/// <param name="solution">Moves in the frame of the given state</param>
+	/// <returns>True on a hit</returns>
+	bool lookup(const Facelets& facelets, Metric metric, std::vector<Rotation>& solution) {
+		const CubeSymmetry& symmetry = CubeSymmetry::instance();
+		const uint64_t stateKey = makeKey(Cube222::encodeFacelets(facelets), metric);
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			auto alias = _aliases.find(stateKey);
+			if (alias != _aliases.end()) {
+				return use(alias->second.entry, alias->second.sym, facelets, solution);
+			}
+		}
+
+		int sym;
+		const uint64_t key = makeKey(symmetry.representative(facelets, sym), metric);
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _index.find(key);
+		if (it == _index.end()) {
+			++_misses;
+			return false;
+		}
+		addAlias(it->second, stateKey, sym);
+		return use(it->second, sym, facelets, solution);
+	}
+
+	/// <summary>
+	/// Add a solution, and append it to the log if one is open
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme with the DBL corner fixed</param>
+	/// <param name="metric">Metric the solution was found in</param>
+	/// <param name="solution">Moves in the frame of the given state</param>
+	void store(const Facelets& facelets, Metric metric, const std::vector<Rotation>& solution) {
+		const CubeSymmetry& symmetry = CubeSymmetry::instance();
+		int sym;
+		const uint32_t rep = symmetry.representative(facelets, sym);
+		std::vector<Rotation> framed;
+		for (Rotation move : solution) {
+			framed.push_back(symmetry.toSymmetryFrame(sym, move));
+		}
+		// Stored in canonical form, so the same class gets the same line whichever state stored it
+		framed = Cube::simplifySolution(framed);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		const uint64_t key = makeKey(rep, metric);
+		if (_index.count(key) > 0) {
+			return;
+		}
+		insert(key, framed);
+		addAlias(_entries.begin(), makeKey(Cube222::encodeFacelets(facelets), metric), sym);
+		if (_log.is_open()) {
+			_log << rep << (metric == HALF_TURN ? " htm " : " qtm ") << framed.size();
+			for (Rotation move : framed) {
+				_log << " " << Cube::rotationToString(move);
+			}
+			_log << "\n" << std::flush;
+		}
+	}
+
+	uint64_t hits() const {
+		return _hits;
+	}
+
+	uint64_t misses() const {
+		return _misses;
+	}
+
+	/// <summary>
+	/// Entries dropped because their solution did not solve the state
+	/// </summary>
+	uint64_t rejected() const {
+		return _rejected;
+	}
+
+	size_t size() const {
+		return _entries.size();
+	}
+
+	size_t capacity() const {
+		return _capacity;
+	}
+
+private:
+	struct Entry {
+		uint64_t key;
+		std::vector<Rotation> solution;     // In the representative's frame
+		std::vector<uint64_t> aliases;      // State keys that point here
+	};
+	using EntryRef = std::list<Entry>::iterator;
+
+	/// <summary>
+	/// A state seen before, with the symmetry that maps it onto its representative
+	/// </summary>
+	struct Alias {
+		EntryRef entry;
+		int sym;
+	};
+
+	size_t _capacity;
+	std::list<Entry> _entries;              // Most recently used first
+	std::unordered_map<uint64_t, EntryRef> _index;
+	std::unordered_map<uint64_t, Alias> _aliases;
+	std::ofstream _log;
+	std::mutex _mutex;
+	uint64_t _hits = 0;
+	uint64_t _misses = 0;
+	uint64_t _rejected = 0;
+
+	static uint64_t makeKey(uint32_t rep, Metric metric) {
+		return (uint64_t)rep << 1 | (metric == HALF_TURN ? 1 : 0);
+	}
+
+	void insert(uint64_t key, const std::vector<Rotation>& solution) {
+		auto it = _index.find(key);
+		if (it != _index.end()) {
+			it->second->solution = solution;
+			_entries.splice(_entries.begin(), _entries, it->second);
+			return;
+		}
+		_entries.push_front({ key, solution, {} });
+		_index[key] = _entries.begin();
+		if (_entries.size() > _capacity) {
+			erase(std::prev(_entries.end()));
+		}
+	}
+
+	void erase(EntryRef entry) {
+		for (uint64_t alias : entry->aliases) {
+			_aliases.erase(alias);
+		}
+		_index.erase(entry->key);
+		_entries.erase(entry);
+	}
+
+	void addAlias(EntryRef entry, uint64_t stateKey, int sym) {
+		if (_aliases.emplace(stateKey, Alias{ entry, sym }).second) {
+			entry->aliases.push_back(stateKey);
+		}
+	}
+
+	/// <summary>
+	/// Translate an entry's solution into the state's frame and check it; a good entry becomes the
+	/// most recently used, a bad one is dropped
+	/// </summary>
+	/// <returns>True on a hit</returns>
+	bool use(EntryRef entry, int sym, const Facelets& facelets, std::vector<Rotation>& solution) {
+		const CubeSymmetry& symmetry = CubeSymmetry::instance();
+		solution.clear();
+		for (Rotation move : entry->solution) {
+			solution.push_back(symmetry.fromSymmetryFrame(sym, move));
+		}
+		if (!Cube222::verify(facelets, solution)) {
+			++_misses;
+			++_rejected;
+			erase(entry);
+			solution.clear();
+			return false;
+		}
+		++_hits;
+		_entries.splice(_entries.begin(), _entries, entry);
+		return true;
+	}
+
+	static bool parseLine(const std::string& line, uint64_t& key, std::vector<Rotation>& solution) {
+		std::istringstream in(line);
+		uint64_t rep;
+		std::string metric;
+		size_t count;
+		if (!(in >> rep >> metric >> count) || rep >= Cube222::StateCount || (metric != "qtm" && metric != "htm")) {
+			return false;
+		}
+		if (!Cube::parseMoves(in, solution) || solution.size() != count) {
+			return false;
+		}
+		key = makeKey((uint32_t)rep, metric == "htm" ? HALF_TURN : QUARTER_TURN);
+		return true;
+	}
+};
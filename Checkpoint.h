@@ -0,0 +1,62 @@
+﻿// Checkpoint.h : Files written whole or not at all, for checkpoints of long searches
+//
+// A checkpoint that is half written when the process dies is worse than none.
+// AtomicFile writes to <path>.tmp and renames it over <path> once the stream is
+// closed without error; the rename replaces the file in one step, so a reader
+// (or a resumed run) sees either the previous checkpoint or the new one. Data
+// is not synced to disk: the files survive a killed process, not a power loss.
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <filesystem>
+
+class AtomicFile {
+public:
+	AtomicFile(const std::string& path) : _path(path), _tempPath(path + ".tmp"), _out(_tempPath, std::ios::binary) {
+	}
+
+	AtomicFile(const AtomicFile&) = delete;
+	AtomicFile& operator=(const AtomicFile&) = delete;
+
+	/// <summary>
+	/// A file never committed is dropped, leaving the previous one in place
+	/// </summary>
+	~AtomicFile() {
+		if (!_committed) {
+			_out.close();
+			std::error_code error;
+			std::filesystem::remove(_tempPath, error);
+		}
+	}
+
+	std::ofstream& stream() {
+		return _out;
+	}
+
+	/// <summary>
+	/// Close the file and move it into place
+	/// </summary>
+	/// <returns>False if a write failed or the file could not be renamed</returns>
+	bool commit() {
+		_out.close();
+		std::error_code error;
+		if (_out) {
+			std::filesystem::rename(_tempPath, _path, error);
+		}
+		if (!_out || error) {
+			std::cerr << "Cannot write " << _path << std::endl;
+			return false;
+		}
+		_committed = true;
+		return true;
+	}
+
+private:
+	std::string _path;
+	std::string _tempPath;
+	std::ofstream _out;
+	bool _committed = false;
+};
@@ -0,0 +1,1523 @@
+﻿// Cube.h : The cube model, Cube and Cube222
+
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <map>
+#include <string>
+#include <cstdint>
+#include <bit>
+#include <atomic>
+#include <algorithm>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+
+#include "Lehmer.h"
+#include "Trace.h"
+#include "Checkpoint.h"
+#include "Pool.h"
+#include "AllocAudit.h"
+
+enum Color { RED, BLUE, ORANGE, GREEN, WHITE, YELLOW, UNDEFINED };
+enum Faces { TOP, FRONT, RIGHT, BOTTOM, BACK, LEFT, NONE };
+enum Rotation { U, D, R, L, F, B, UI, DI, RI, LI, FI, BI, U2, D2, R2, L2, F2, B2 };
+enum ValidationError { VALID, INVALID_COLOR, WRONG_COLOR_COUNT, INVALID_CORNER, DUPLICATE_CORNER, TWISTED_CORNER };
+
+enum SearchStatus { SOLVED, TIMEOUT, NODE_LIMIT, DEPTH_LIMIT, CANCELLED, INVALID_STATE };
+
+// Quarter turn metric: a half turn costs two moves. Half turn metric: every face turn costs one.
+enum Metric { QUARTER_TURN, HALF_TURN };
+
+/// <summary>
+/// Inverse of a move, a half turn is its own inverse
+/// </summary>
+inline Rotation inverseRotation(Rotation r) {
+	return r >= U2 ? r : (Rotation)((r + 6) % 12);
+}
+
+/// <summary>
+/// Face turned by a move, as the clockwise quarter turn of that face
+/// </summary>
+inline Rotation rotationFace(Rotation r) {
+	return r >= U2 ? (Rotation)(r - U2) : (Rotation)(r % 6);
+}
+
+/// <summary>
+/// Flag that another thread (or a signal handler) sets to stop a running search
+/// </summary>
+class CancellationToken {
+public:
+	void cancel() {
+		_cancelled.store(true, std::memory_order_relaxed);
+	}
+
+	bool isCancelled() const {
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<bool> _cancelled{ false };
+};
+
+class Cube;
+
+/// <summary>
+/// Exact distances of the states near solved, probed by a search once the moves left fit
+/// in the probe's depth
+/// </summary>
+class EndgameProbe {
+public:
+	virtual ~EndgameProbe() = default;
+
+	/// <summary>
+	/// Whether the probe knows this kind of cube
+	/// </summary>
+	virtual bool supports(const Cube& cube) const = 0;
+
+	/// <summary>
+	/// Distance to solved and the moves that get there
+	/// </summary>
+	/// <param name="cube">Cube, of a supported kind</param>
+	/// <param name="finish">Optimal moves to solved, if within depth</param>
+	/// <returns>Distance, -1 if more than depth moves</returns>
+	virtual int probe(const Cube& cube, std::vector<Rotation>& finish) const = 0;
+
+	virtual int depth() const = 0;
+
+	virtual Metric metric() const = 0;
+};
+
+/// <summary>
+/// Budgets for a search, 0 means unlimited
+/// </summary>
+struct SolveOptions {
+	double timeLimit = 0;                       // Wall clock seconds
+	uint64_t maxNodes = 0;                      // Nodes expanded
+	int maxDepth = 0;                           // Moves in a solution
+	Metric metric = QUARTER_TURN;               // How moves are counted
+	const CancellationToken* cancel = nullptr;  // Checked together with the clock
+	uint64_t checkInterval = 4096;              // Nodes between clock and cancellation checks
+	const EndgameProbe* endgame = nullptr;      // Finishes and prunes the last plies, used by dfs
+	std::string checkpoint;                     // File the dfs saves its progress to, empty for none
+	double checkpointInterval = 60;             // Seconds between checkpoints, 0 after every root move
+	bool resume = false;                        // Start from the checkpoint if it is of the same cube and metric
+};
+
+/// <summary>
+/// Counters of a search, to tune the pruning and size the hardware. Per ply of the search
+/// tree: nodes expanded, nodes cut off because the heuristic bound exceeded the moves left,
+/// and moves skipped by the move ordering rules (a move undoing the last one, ...).
+/// </summary>
+struct SearchStats {
+	struct Ply {
+		uint64_t nodes = 0;
+		uint64_t cutoffs = 0;
+		uint64_t skipped = 0;
+	};
+
+	/// <summary>
+	/// One iteration of iterative deepening
+	/// </summary>
+	struct Iteration {
+		int bound;
+		uint64_t nodes;
+		double seconds;
+	};
+
+	std::vector<Ply> plies;
+	std::vector<Iteration> iterations;
+	uint64_t nodes = 0;
+	uint64_t cutoffs = 0;
+	uint64_t skipped = 0;
+	uint64_t endgameProbes = 0;                 // Endgame table lookups, the only table the searches probe
+	uint64_t endgameHits = 0;
+	uint64_t allocations = 0;                   // Heap allocations in the node loops, counted by AllocAudit
+	double seconds = 0;
+
+	Ply& ply(int depth) {
+		if (depth >= (int)plies.size()) {
+			plies.resize(depth + 1);
+		}
+		return plies[depth];
+	}
+
+	double nodesPerSecond() const {
+		return seconds > 0 ? nodes / seconds : 0;
+	}
+
+	/// <summary>
+	/// Share of the generated children that were never searched below
+	/// </summary>
+	double pruneRate() const {
+		return nodes + skipped > 0 ? (double)(cutoffs + skipped) / (nodes + skipped) : 0;
+	}
+
+	/// <summary>
+	/// Share of the expanded nodes cut off by the heuristic
+	/// </summary>
+	double cutoffRate() const {
+		return nodes > 0 ? (double)cutoffs / nodes : 0;
+	}
+
+	std::string toJson() const {
+		std::ostringstream out;
+		out << "{\"nodes\":" << nodes << ",\"cutoffs\":" << cutoffs << ",\"skipped\":" << skipped
+			<< ",\"seconds\":" << seconds << ",\"nodes_per_second\":" << nodesPerSecond()
+			<< ",\"prune_rate\":" << pruneRate() << ",\"cutoff_rate\":" << cutoffRate()
+			<< ",\"endgame_probes\":" << endgameProbes << ",\"endgame_hits\":" << endgameHits
+			<< ",\"allocations\":" << allocations
+			<< ",\"plies\":[";
+		for (size_t i = 0; i < plies.size(); ++i) {
+			out << (i > 0 ? "," : "") << "{\"ply\":" << i << ",\"nodes\":" << plies[i].nodes
+				<< ",\"cutoffs\":" << plies[i].cutoffs << ",\"skipped\":" << plies[i].skipped << "}";
+		}
+		out << "],\"iterations\":[";
+		for (size_t i = 0; i < iterations.size(); ++i) {
+			out << (i > 0 ? "," : "") << "{\"bound\":" << iterations[i].bound << ",\"nodes\":" << iterations[i].nodes
+				<< ",\"seconds\":" << iterations[i].seconds << "}";
+		}
+		out << "]}";
+		return out.str();
+	}
+};
+
+/// <summary>
+/// Node count, clock and stop reason of a running search. withinBudget is called once per
+/// node; it checks the node budget exactly and the clock and cancellation flag only every
+/// checkInterval nodes.
+/// </summary>
+class SearchBudget {
+public:
+	const SolveOptions& options;
+	std::chrono::steady_clock::time_point begin;
+	std::chrono::steady_clock::time_point deadline;
+	uint64_t nodes = 0;
+	uint64_t nextCheck;
+	SearchStatus status = SOLVED;
+	bool stopped = false;
+	SearchStats stats;
+
+	SearchBudget(const SolveOptions& searchOptions)
+		: options(searchOptions), begin(std::chrono::steady_clock::now()),
+		deadline(begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(searchOptions.timeLimit))),
+		nextCheck(searchOptions.checkInterval) {
+	}
+
+	double elapsed() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	}
+
+	/// <summary>
+	/// Count a node at a ply of the search tree
+	/// </summary>
+	void expand(int ply) {
+		++nodes;
+		++stats.ply(ply).nodes;
+	}
+
+	/// <summary>
+	/// Count a node whose heuristic bound exceeds the moves left
+	/// </summary>
+	void cutoff(int ply) {
+		++stats.ply(ply).cutoffs;
+	}
+
+	/// <summary>
+	/// Count a move the move ordering rules leave out
+	/// </summary>
+	void skip(int ply) {
+		++stats.ply(ply).skipped;
+	}
+
+	/// <summary>
+	/// Close an iteration of iterative deepening
+	/// </summary>
+	void endIteration(int bound, uint64_t nodesBefore, double secondsBefore) {
+		stats.iterations.push_back({ bound, nodes - nodesBefore, elapsed() - secondsBefore });
+	}
+
+	/// <summary>
+	/// Totals of the per ply counters, once the search is over
+	/// </summary>
+	SearchStats finishStats() {
+		stats.nodes = nodes;
+		stats.cutoffs = 0;
+		stats.skipped = 0;
+		for (const SearchStats::Ply& ply : stats.plies) {
+			stats.cutoffs += ply.cutoffs;
+			stats.skipped += ply.skipped;
+		}
+		stats.seconds = elapsed();
+		return stats;
+	}
+
+	/// <summary>
+	/// Check the budgets
+	/// </summary>
+	/// <returns>False once the search has to stop, with status set</returns>
+	bool withinBudget() {
+		if (stopped) {
+			return false;
+		}
+		if (options.maxNodes > 0 && nodes >= options.maxNodes) {
+			status = NODE_LIMIT;
+		}
+		else if (nodes >= nextCheck) {
+			nextCheck = nodes + options.checkInterval;
+			if (options.cancel != nullptr && options.cancel->isCancelled()) {
+				status = CANCELLED;
+			}
+			else if (options.timeLimit > 0 && std::chrono::steady_clock::now() >= deadline) {
+				status = TIMEOUT;
+			}
+		}
+		stopped = status != SOLVED;
+		return !stopped;
+	}
+};
+
+/// <summary>
+/// Outcome of a search: the solution when SOLVED, otherwise the best partial sequence
+/// </summary>
+struct SolveResult {
+	SearchStatus status = SOLVED;
+	std::vector<Rotation> solution;
+	uint64_t nodes = 0;
+	double seconds = 0;
+	bool optimal = false;                       // The search proved no shorter solution exists
+	SearchStats stats;
+};
+
+/// <summary>
+/// Outcome of Cube222::validate
+/// </summary>
+struct ValidationResult {
+	ValidationError error;
+	std::string message;
+
+	bool isValid() const {
+		return error == VALID;
+	}
+};
+
+inline std::map<char, Color> charToColor = {
+	{'R', RED}, {'B', BLUE}, {'O', ORANGE}, {'G', GREEN}, {'W', WHITE}, {'Y', YELLOW}
+};
+
+inline std::map<std::string, Faces> tagToFace = {
+	{"-ft", TOP}, {"-ff", FRONT}, {"-fr", RIGHT}, {"-fb", BOTTOM}, {"-fbk", BACK}, {"-fl", LEFT}
+};
+
+class Cube {
+public:
+	/// <summary>
+	/// Constructor of The Cube
+	/// </summary>
+	/// <param name="initialColor">Initial Color</param>
+	/// <param name="cRow">Row Count For Each Face</param>
+	/// <param name="cCol">Col Count For Each Face</param>
+	/// <param name="cFace">Face Count</param>
+	Cube(Color initialColor, int cRow, int cCol, int cFace)
+		: _cRow(cRow), _cCol(cCol), _cFace(cFace),
+		_matrix(cFace, std::vector<std::vector<Color>>(cCol, std::vector<Color>(cRow, initialColor))) {
+
+		setColorsToInitState();
+	}
+
+	// Subclasses are used and may be deleted through Cube& and Cube*
+	virtual ~Cube() = default;
+	Cube(const Cube&) = default;
+	Cube(Cube&&) = default;
+	Cube& operator=(const Cube&) = default;
+	Cube& operator=(Cube&&) = default;
+
+	/// <summary>
+	/// Goto init state
+	/// </summary>
+	void setColorsToInitState() {
+		setColor(FRONT, BLUE);
+		setColor(RIGHT, RED);
+		setColor(TOP, YELLOW);
+		setColor(BOTTOM, WHITE);
+		setColor(BACK, GREEN);
+		setColor(LEFT, ORANGE);
+		_rotations.clear();
+	}
+
+	void saveInitState() {
+		_initMatrix = _matrix;
+	}
+
+	void reset() {
+		_matrix = _initMatrix;
+		_rotations.clear();
+	}
+
+	/// <summary>
+	/// Function to set the colors of the face
+	/// </summary>
+	/// <param name="face">Face</param>
+	/// <param name="colors">Colors</param>
+	void setColor(Faces face, const std::vector<Color>& colors) {
+		for (int i = 0; i < _cRow; ++i) {
+			for (int j = 0; j < _cCol; ++j) {
+				int idx = i * _cCol + j;  // Flatten the row/col to index
+				if (idx < colors.size()) {
+					_matrix[face][i][j] = colors[idx];
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// Function to set the color of the face
+	/// </summary>
+	/// <param name="face">Face</param>
+	/// <param name="color">Color</param>
+	void setColor(Faces face, Color color) {
+		for (int r = 0; r < _cRow; r++) {
+			for (int c = 0; c < _cCol; c++) {
+				setColor(face, r, c, color);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Function to set the color of a specific cell
+	/// </summary>
+	/// <param name="face">Face</param>
+	/// <param name="row">Row</param>
+	/// <param name="col">Column</param>
+	/// <param name="color">Color</param>
+	void setColor(Faces face, int row, int col, Color color) {
+		if (row >= 0 && row < _cRow && col >= 0 && col < _cCol) {
+			_matrix[face][row][col] = color;
+		}
+		else {
+			std::cerr << "Index out of bounds error." << std::endl;
+		}
+	}
+
+	/// <summary>
+	/// Function to get the color of a specific cell
+	/// </summary>
+	/// <param name="face">Face</param>
+	/// <param name="row">Row</param>
+	/// <param name="col">Column</param>
+	/// <param name="color">Color</param>
+	/// <returns>Color</returns>
+	Color getColor(Faces face, int row, int col) const {
+		if (row >= 0 && row < _cRow && col >= 0 && col < _cCol) {
+			return _matrix[face][row][col];
+		}
+		else {
+			std::cerr << "Index out of bounds error." << std::endl;
+			return Color::WHITE;  // Default return
+		}
+	}
+
+	/// <summary>
+	/// Make a rotation
+	/// </summary>
+	/// <param name="r">Rotation</param>
+	virtual void applyRotation(Rotation r) {
+		_rotations.push_back(r);
+	}
+
+	/// <summary>
+	/// Utility to print the cube's configuration
+	/// </summary>
+	/// <param name="shortPrint"></param>
+	void printCube(bool shortPrint = false) {
+		std::string solvedStr = isSolved() ? "YES" : "NO";
+		std::cout << "Solved: " << solvedStr << std::endl;
+		std::cout << "Rotations: " << rotationsToString() << std::endl;
+		if (shortPrint) {
+			for (int f = 0; f < _cFace / 2; ++f) {
+				std::cout << "Face: " << faceToString((Faces)f) << std::endl;
+				for (const auto& row : _matrix[f]) {
+					for (Color color : row) {
+						std::cout << colorToString(color) << " ";
+					}
+					std::cout << std::endl;
+				}
+			}
+		}
+		else {
+			for (int f = 0; f < _cFace; ++f) {
+				std::cout << "Face: " << faceToString((Faces)f) << std::endl;
+				for (const auto& row : _matrix[f]) {
+					for (Color color : row) {
+						std::cout << colorToString(color) << " ";
+					}
+					std::cout << std::endl;
+				}
+				std::cout << std::endl;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Check if tich cube is solved or not
+	/// </summary>
+	/// <returns>Solved or Not</returns>
+	inline bool isSolved() const {
+		for (size_t f = 0; f < _cFace/2; ++f) {
+			const auto& face = _matrix[f];
+			const Color referenceColor = face[0][0];
+			for (size_t i = 0; i < _cCol; ++i) {
+				for (size_t j = 0; j < _cRow; ++j) {
+					if (face[i][j] != referenceColor) {
+						return false;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Apply A solution to this cube
+	/// </summary>
+	/// <param name="solution">A solution array from rotations enum elements</param>
+	void applySolution(const std::vector<Rotation>& solution) {
+		for (Rotation move : solution) {
+			applyRotation(move);
+		}
+	}
+
+	/// <summary>
+	/// Replace the rotations log by its simplifySolution form
+	/// </summary>
+	void simplifyRotations() {
+		_rotations = simplifySolution(_rotations);
+	}
+
+	/// <summary>
+	/// Iterative deepening depth first search for the shortest solution in the options' metric. The search stops at
+	/// the options' deadline, node budget, depth limit or cancellation and then reports the
+	/// best partial result found so far. With a checkpoint file the bound and the root moves whose
+	/// subtrees are searched at that bound are saved every checkpointInterval seconds and when the
+	/// search stops, and a resumed search skips what they cover.
+	/// </summary>
+	/// <param name="options">Search budgets</param>
+	/// <returns>Status, solution (or best partial sequence) and node count</returns>
+	virtual SolveResult dfs(const SolveOptions& options = SolveOptions()) {
+		TRACE_SPAN("solver", "dfs");
+		SearchContext context(options, _rotations.size());
+		context.bestProgress = progress();
+		if (options.endgame != nullptr && options.endgame->metric() == options.metric && options.endgame->supports(*this)) {
+			context.endgame = options.endgame;
+		}
+
+		int firstDepth = 0;
+		if (options.resume && loadCheckpoint(options.checkpoint, options.metric, firstDepth, context.completed)) {
+			std::cout << "Resuming at depth " << firstDepth << " with " << context.completed.size() << " root moves searched.\n";
+		}
+		context.completed.reserve(searchRotations(options.metric).size());
+		context.finish.reserve(context.endgame != nullptr ? context.endgame->depth() : 0);
+
+		for (int depth = firstDepth; ; ++depth) {
+			TRACE_SPAN_VALUE("solver", "iteration", depth);
+			context.bound = depth;
+			if (options.maxDepth > 0 && depth > options.maxDepth) {
+				context.status = DEPTH_LIMIT;
+				context.stopped = true;
+				break;
+			}
+
+			// Room for the longest path of the iteration and the undo move past it, so that the nodes allocate nothing
+			_rotations.reserve(context.base + depth + 1);
+			context.bestPath.reserve(depth);
+			context.stats.plies.reserve(depth + 1);
+
+			const uint64_t nodesBefore = context.nodes;
+			const double secondsBefore = context.elapsed();
+			bool solved;
+			{
+				AllocAudit::Scope audit;
+				solved = search(depth, context);
+				context.stats.allocations += audit.allocations();
+			}
+			context.endIteration(depth, nodesBefore, secondsBefore);
+			if (solved || context.stopped) {
+				break;
+			}
+			context.completed.clear();
+
+			std::cout << "Depth " << depth << ": " << context.nodes - nodesBefore << " nodes, " << context.elapsed() << " seconds elapsed.\n";
+		}
+
+		SolveResult result;
+		result.status = context.status;
+		result.nodes = context.nodes;
+		result.seconds = context.elapsed();
+		result.optimal = result.status == SOLVED;
+		result.stats = context.finishStats();
+		if (!options.checkpoint.empty()) {
+			if (result.status == SOLVED || result.status == DEPTH_LIMIT) {
+				std::error_code error;
+				std::filesystem::remove(options.checkpoint, error);
+			}
+			else {
+				saveCheckpoint(context);
+			}
+		}
+		if (result.status == SOLVED) {
+			result.solution = simplifySolution(std::vector<Rotation>(_rotations.begin() + context.base, _rotations.end()));
+			std::cout << "Solved in " << result.seconds << " seconds.\n";
+			std::cout << "Solution: ";
+		}
+		else {
+			result.solution = context.bestPath;
+			std::cout << "Search stopped (" << searchStatusToString(result.status) << ") after " << result.nodes << " nodes, " << result.seconds << " seconds.\n";
+			std::cout << "Best partial: ";
+		}
+		for (Rotation move : result.solution) {
+			std::cout << rotationToString(move) << " ";
+		}
+		std::cout << "\n";
+		return result;
+	}
+
+	/// <summary>
+	/// Length of a move sequence in a metric
+	/// </summary>
+	/// <param name="solution">Moves</param>
+	/// <param name="metric">Metric</param>
+	/// <returns>Move count, half turns count twice in the quarter turn metric</returns>
+	static int solutionLength(const std::vector<Rotation>& solution, Metric metric) {
+		int length = 0;
+		for (Rotation move : solution) {
+			length += metric == QUARTER_TURN && move >= U2 ? 2 : 1;
+		}
+		return length;
+	}
+
+	/// <summary>
+	/// Shorten a move sequence without changing what it does. Moves of one axis commute, so each
+	/// run of them becomes at most one turn per face, the U, R or F face first; a run that cancels
+	/// out is dropped and the runs either side of it merge in turn. One pass over a stack of runs.
+	/// </summary>
+	/// <param name="moves">Moves</param>
+	/// <returns>Moves in canonical form, e.g. "U D U" gives "U2 D" and "R U UI RI" nothing</returns>
+	static std::vector<Rotation> simplifySolution(const std::vector<Rotation>& moves) {
+		struct Run {
+			int axis;                           // Face / 2: U and D, R and L, F and B
+			int quarters[2];                    // Clockwise quarter turns of each face, mod 4
+		};
+		std::vector<Run> runs;
+		for (Rotation move : moves) {
+			const int face = rotationFace(move);
+			if (runs.empty() || runs.back().axis != face / 2) {
+				runs.push_back({ face / 2, { 0, 0 } });
+			}
+			Run& run = runs.back();
+			run.quarters[face % 2] = (run.quarters[face % 2] + (move >= U2 ? 2 : move >= UI ? 3 : 1)) % 4;
+			if (run.quarters[0] == 0 && run.quarters[1] == 0) {
+				runs.pop_back();
+			}
+		}
+
+		static constexpr Rotation byQuarters[4] = { U, U, U2, UI };
+		std::vector<Rotation> simplified;
+		for (const Run& run : runs) {
+			for (int side = 0; side < 2; ++side) {
+				if (run.quarters[side] != 0) {
+					simplified.push_back((Rotation)(byQuarters[run.quarters[side]] + run.axis * 2 + side));
+				}
+			}
+		}
+		return simplified;
+	}
+
+	/// <summary>
+	/// Convert SearchStatus enum to string
+	/// </summary>
+	/// <param name="status">Status</param>
+	/// <returns>String Of the SearchStatus Enum</returns>
+	static std::string searchStatusToString(SearchStatus status) {
+		switch (status) {
+		case SOLVED:      return "solved";
+		case TIMEOUT:     return "timeout";
+		case NODE_LIMIT:  return "node limit";
+		case DEPTH_LIMIT: return "depth limit";
+		case CANCELLED:   return "cancelled";
+		case INVALID_STATE: return "invalid state";
+		default:          return "unknown";
+		}
+	}
+
+	/// <summary>
+	/// Convert Rotation enum to string
+	/// </summary>
+	/// <param name="r">Rotation</param>
+	/// <returns>String On the Rotation in the Enum</returns>
+	static std::string rotationToString(Rotation r) {
+		switch (r)
+		{
+		case U:		return "U";
+		case D:		return "D";
+		case R:		return "R";
+		case L:		return "L";
+		case F:		return "F";
+		case B:		return "B";
+		case UI:	return "UI";
+		case DI:	return "DI";
+		case RI:	return "RI";
+		case LI:	return "LI";
+		case FI:	return "FI";
+		case BI:	return "BI";
+		case U2:	return "U2";
+		case D2:	return "D2";
+		case R2:	return "R2";
+		case L2:	return "L2";
+		case F2:	return "F2";
+		case B2:	return "B2";
+		default:	return "X";
+		}
+	}
+
+	/// <summary>
+	/// Convert a move name back to its Rotation
+	/// </summary>
+	/// <param name="name">Name as rotationToString gives it</param>
+	/// <param name="r">The Rotation</param>
+	/// <returns>False for an unknown name</returns>
+	static bool rotationFromString(const std::string& name, Rotation& r) {
+		for (int move = 0; move <= B2; ++move) {
+			if (rotationToString((Rotation)move) == name) {
+				r = (Rotation)move;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Parse a move sequence written as names separated by spaces, e.g. "R U RI UI"
+	/// </summary>
+	/// <param name="in">Move names</param>
+	/// <param name="moves">The moves, appended</param>
+	/// <returns>False if a name is unknown</returns>
+	static bool parseMoves(std::istream& in, std::vector<Rotation>& moves) {
+		std::string name;
+		while (in >> name) {
+			Rotation r;
+			if (!rotationFromString(name, r)) {
+				return false;
+			}
+			moves.push_back(r);
+		}
+		return true;
+	}
+
+protected:
+
+	int _cRow;
+	int _cCol;
+	int _cFace;
+
+	std::vector<std::vector<std::vector<Color>>> _matrix;
+	std::vector<std::vector<std::vector<Color>>> _initMatrix;
+	std::vector<Rotation> _rotations;
+
+	/// <summary>
+	/// State of one dfs call
+	/// </summary>
+	struct SearchContext : SearchBudget {
+		size_t base;
+		int bestProgress = 0;
+		std::vector<Rotation> bestPath;
+		const EndgameProbe* endgame = nullptr;
+		std::vector<Rotation> finish;
+		int bound = 0;
+		std::vector<Rotation> completed;        // Root moves whose subtrees are searched at bound
+		double lastCheckpoint = 0;
+
+		SearchContext(const SolveOptions& searchOptions, size_t rotationCount)
+			: SearchBudget(searchOptions), base(rotationCount) {
+		}
+	};
+
+	/// <summary>
+	/// Colors of every sticker, one letter each, to tell whether a checkpoint is of this cube
+	/// </summary>
+	std::string stateString() const {
+		std::string state;
+		for (const auto& face : _matrix) {
+			for (const auto& row : face) {
+				for (Color color : row) {
+					state += colorToString(color, true);
+				}
+			}
+		}
+		return state;
+	}
+
+	/// <summary>
+	/// Write the search progress as one line
+	///   dfs <qtm|htm> <stickers> <bound> <move count> <root moves...>
+	/// with the cube back at the root of the search
+	/// </summary>
+	void saveCheckpoint(SearchContext& context) {
+		AllocAudit::Pause pause;
+		AtomicFile file(context.options.checkpoint);
+		file.stream() << "dfs " << (context.options.metric == HALF_TURN ? "htm " : "qtm ") << stateString() << " " << context.bound << " " << context.completed.size();
+		for (Rotation move : context.completed) {
+			file.stream() << " " << rotationToString(move);
+		}
+		file.stream() << "\n";
+		file.commit();
+		context.lastCheckpoint = context.elapsed();
+	}
+
+	/// <summary>
+	/// Read the progress saved by saveCheckpoint
+	/// </summary>
+	/// <param name="path">Checkpoint file</param>
+	/// <param name="metric">Metric of the search</param>
+	/// <param name="bound">Bound the search was at</param>
+	/// <param name="completed">Root moves searched at that bound</param>
+	/// <returns>False if there is no checkpoint, or it is of another cube or metric</returns>
+	bool loadCheckpoint(const std::string& path, Metric metric, int& bound, std::vector<Rotation>& completed) const {
+		std::ifstream in(path);
+		std::string kind;
+		std::string metricName;
+		std::string state;
+		size_t count;
+		if (!(in >> kind >> metricName >> state >> bound >> count)) {
+			return false;
+		}
+		if (kind != "dfs" || metricName != (metric == HALF_TURN ? "htm" : "qtm") || state != stateString()) {
+			std::cout << "Checkpoint " << path << " is of another cube or metric, starting over.\n";
+			return false;
+		}
+		completed.clear();
+		return parseMoves(in, completed) && completed.size() == count;
+	}
+
+	/// <summary>
+	/// Moves tried at each node of the search, the half turns only in the half turn metric
+	/// </summary>
+	virtual const std::vector<Rotation>& searchRotations(Metric metric) const {
+		static const std::vector<Rotation> quarterTurns = { U, D, R, L, F, B, UI, DI, RI, LI, FI, BI };
+		static const std::vector<Rotation> faceTurns = { U, D, R, L, F, B, UI, DI, RI, LI, FI, BI, U2, D2, R2, L2, F2, B2 };
+		return metric == HALF_TURN ? faceTurns : quarterTurns;
+	}
+
+	/// <summary>
+	/// How close the cube looks to solved: the stickers matching the most common color of their face
+	/// </summary>
+	/// <returns>Progress, _cFace * _cRow * _cCol when solved</returns>
+	int progress() const {
+		int total = 0;
+		for (int f = 0; f < _cFace; ++f) {
+			std::array<int, UNDEFINED + 1> counts = {};
+			for (const auto& row : _matrix[f]) {
+				for (Color color : row) {
+					++counts[color];
+				}
+			}
+			total += *std::max_element(counts.begin(), counts.end());
+		}
+		return total;
+	}
+
+	/// <summary>
+	/// Depth limited search below the current node; the moves of a solution stay applied
+	/// </summary>
+	/// <param name="remaining">Moves left at this iteration</param>
+	/// <param name="context">Search state</param>
+	/// <returns>True if solved</returns>
+	bool search(int remaining, SearchContext& context) {
+		const int ply = (int)(_rotations.size() - context.base);
+		context.expand(ply);
+		if (isSolved()) {
+			return true;
+		}
+
+		const int score = progress();
+		if (score > context.bestProgress) {
+			context.bestProgress = score;
+			context.bestPath.assign(_rotations.begin() + context.base, _rotations.end());
+		}
+
+		if (!context.withinBudget()) {
+			return false;
+		}
+
+		// Near the leaves the endgame table knows the exact distance: finish, or cut off
+		if (context.endgame != nullptr && remaining <= context.endgame->depth()) {
+			++context.stats.endgameProbes;
+			const int distance = context.endgame->probe(*this, context.finish);
+			if (distance < 0 || distance > remaining) {
+				context.cutoff(ply);
+				return false;
+			}
+			++context.stats.endgameHits;
+			for (Rotation move : context.finish) {
+				applyRotation(move);
+			}
+			return true;
+		}
+
+		if (remaining == 0) {
+			return false;
+		}
+
+		const bool hasLast = _rotations.size() > context.base;
+		const Rotation last = hasLast ? _rotations.back() : U;
+		const Metric metric = context.options.metric;
+		for (Rotation r : searchRotations(metric)) {
+			// A resumed search does not repeat the root subtrees the checkpoint covers
+			if (ply == 0 && std::find(context.completed.begin(), context.completed.end(), r) != context.completed.end()) {
+				continue;
+			}
+			// A move never undoes the last one; in the half turn metric two turns of the same face are one move
+			if (hasLast && (r == inverseRotation(last) || (metric == HALF_TURN && rotationFace(r) == rotationFace(last)))) {
+				context.skip(ply);
+				continue;
+			}
+			applyRotation(r);
+			if (search(remaining - 1, context)) {
+				return true;
+			}
+			applyRotation(inverseRotation(r));
+			_rotations.resize(_rotations.size() - 2);
+			if (context.stopped) {
+				return false;
+			}
+			if (ply == 0) {
+				context.completed.push_back(r);
+				if (!context.options.checkpoint.empty() && context.elapsed() - context.lastCheckpoint >= context.options.checkpointInterval) {
+					saveCheckpoint(context);
+				}
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Convert Rotations Log to string
+	/// </summary>
+	/// <returns>Rotation String</returns>
+	std::string rotationsToString() {
+		std::string retVal = "";
+		for (Rotation r : _rotations) {
+			retVal.append(rotationToString(r) + " ");
+		}
+		return retVal;
+	}
+
+	/// <summary>
+	/// Convert Color enum to string
+	/// </summary>
+	/// <param name="color">Color</param>
+	/// <param name="shortPrint">Short Print: For Small Console Output</param>
+	/// <returns>String Of the Color Enum</returns>
+	static std::string colorToString(Color color, bool shortPrint = false) {
+		if (shortPrint) {
+			switch (color) {
+			case RED:    return "R";
+			case BLUE:   return "B";
+			case ORANGE: return "O";
+			case GREEN:  return "G";
+			case WHITE:  return "W";
+			case YELLOW: return "Y";
+			default:     return "U";
+			}
+		}
+		else {
+			switch (color) {
+			case RED:    return "RED";
+			case BLUE:   return "BLUE";
+			case ORANGE: return "ORANGE";
+			case GREEN:  return "GREEN";
+			case WHITE:  return "WHITE";
+			case YELLOW: return "YELLOW";
+			default:     return "UNKNOWN";
+			}
+		}
+	}
+
+	/// <summary>
+	/// Convert Faces enum to string
+	/// </summary>
+	/// <param name="face">Face</param>
+	/// <param name="shortPrint">Short Print: For Small Console Output</param>
+	/// <returns>String Of the Faces Enum</returns>
+	std::string faceToString(Faces face, bool shortPrint = false) {
+		if (shortPrint) {
+			switch (face) {
+			case FRONT:  return "F";
+			case RIGHT:  return "R";
+			case BACK:   return "B";
+			case LEFT:   return "L";
+			case TOP:    return "T";
+			case BOTTOM: return "B";
+			default:     return "U";
+			}
+		}
+		else {
+			switch (face) {
+			case FRONT:  return "FRONT";
+			case RIGHT:  return "RIGHT";
+			case BACK:   return "BACK";
+			case LEFT:   return "LEFT";
+			case TOP:    return "TOP";
+			case BOTTOM: return "BOTTOM";
+			default:     return "UNKNOWN";
+			}
+		}
+	}
+};
+
+class Cube222 : public Cube {
+public:
+
+	/// <summary>
+	/// Constructor of The Cube 2x2x2
+	/// </summary>
+	/// <param name="initialColor">Initial Color</param>
+	/// <param name="cRow">Row Count For Each Face</param>
+	/// <param name="cCol">Col Count For Each Face</param>
+	/// <param name="cFace">Face Count</param>
+	Cube222(Color initialColor = Color::WHITE, int cRow = 2, int cCol = 2, int cFace = 6) :
+		Cube(initialColor, cRow, cCol, cFace) {
+	}
+
+	/// <summary>
+	/// Copy of the cube in an object of the calling thread's pool, which takes it back when the
+	/// handle is dropped. No heap allocation once the pool has objects to reuse.
+	/// </summary>
+	/// <returns>Owning handle</returns>
+	ObjectPool<Cube222>::Handle copy() const {
+		return ObjectPool<Cube222>::local().acquire(*this);
+	}
+
+	/// <summary>
+	/// Cube::dfs on the cube relabeled by normalizeOrientation first. The search turns only U, R
+	/// and F, and the endgame table holds states in the init scheme, so both take the DBL corner
+	/// to read WHITE, GREEN, ORANGE. A cube whose color scheme cannot be worked out is not searched.
+	/// </summary>
+	/// <param name="options">Search budgets</param>
+	/// <returns>Status, INVALID_STATE if the cube cannot be normalized, solution and node count</returns>
+	SolveResult dfs(const SolveOptions& options = SolveOptions()) override {
+		if (!normalizeOrientation()) {
+			std::cout << "Search stopped (" << searchStatusToString(INVALID_STATE) << "): the color scheme cannot be worked out.\n";
+			SolveResult result;
+			result.status = INVALID_STATE;
+			return result;
+		}
+		return Cube::dfs(options);
+	}
+
+	/// <summary>
+	/// Corner positions in URF, UFL, ULB, UBR, DFR, DLF, DBL, DRB order. Each corner is
+	/// listed as facelet indices (face * 4 + row * 2 + col), U/D sticker first, then clockwise.
+	/// </summary>
+	static constexpr int CornerCount = 8;
+	static constexpr std::array<std::array<int, 3>, CornerCount> cornerFacelets = { {
+		{ 3, 8, 5 }, { 2, 4, 21 }, { 0, 20, 17 }, { 1, 16, 9 },
+		{ 13, 7, 10 }, { 12, 23, 6 }, { 14, 19, 22 }, { 15, 11, 18 }
+	} };
+
+	/// <summary>
+	/// Face colors of the init state, indexed by Faces
+	/// </summary>
+	static constexpr std::array<Color, 6> initFaceColors = { YELLOW, BLUE, RED, WHITE, GREEN, ORANGE };
+
+	/// <summary>
+	/// Opposite face color in the init state, indexed by Color
+	/// </summary>
+	static constexpr std::array<Color, 6> initOppositeColors = { ORANGE, GREEN, RED, BLUE, YELLOW, WHITE };
+
+	/// <summary>
+	/// Number of corner states: 8! permutations times 3^7 orientations
+	/// </summary>
+	static constexpr uint32_t StateCount = (uint32_t)(Lehmer::factorial(CornerCount) * Lehmer::power(3, CornerCount - 1));
+	static constexpr uint32_t InvalidState = UINT32_MAX;
+
+	/// <summary>
+	/// Sticker colors by facelet index (face * 4 + row * 2 + col), the flat form of the matrix
+	/// used by tables and symmetries
+	/// </summary>
+	static constexpr int FaceletCount = 24;
+	using Facelets = std::array<uint8_t, FaceletCount>;
+
+	/// <summary>
+	/// Facelet permutation of each Rotation: after the move, facelet i holds the sticker
+	/// that was on facelet moveFacelets[r][i]. It is the one definition of the moves:
+	/// applyRotation, the dfs, the tables, the symmetries and the batch all apply this table,
+	/// so every solver searches the same moves. A half turn is its quarter turn applied twice.
+	/// </summary>
+	static constexpr int RotationCount = 18;
+	static constexpr std::array<Facelets, RotationCount> moveFacelets = { {
+		{ 2, 0, 3, 1, 8, 9, 6, 7, 16, 17, 10, 11, 12, 13, 14, 15, 20, 21, 18, 19, 4, 5, 22, 23 }, // U
+		{ 0, 1, 2, 3, 4, 5, 22, 23, 8, 9, 6, 7, 14, 12, 15, 13, 16, 17, 10, 11, 20, 21, 18, 19 }, // D
+		{ 0, 5, 2, 7, 4, 13, 6, 15, 10, 8, 11, 9, 12, 18, 14, 16, 3, 17, 1, 19, 20, 21, 22, 23 }, // R
+		{ 19, 1, 17, 3, 0, 5, 2, 7, 8, 9, 10, 11, 4, 13, 6, 15, 16, 14, 18, 12, 22, 20, 23, 21 }, // L
+		{ 0, 1, 23, 21, 6, 4, 7, 5, 2, 9, 3, 11, 10, 8, 14, 15, 16, 17, 18, 19, 20, 12, 22, 13 }, // F
+		{ 9, 11, 2, 3, 4, 5, 6, 7, 8, 15, 10, 14, 12, 13, 20, 22, 18, 16, 19, 17, 1, 21, 0, 23 }, // B
+		{ 1, 3, 0, 2, 20, 21, 6, 7, 4, 5, 10, 11, 12, 13, 14, 15, 8, 9, 18, 19, 16, 17, 22, 23 }, // UI
+		{ 0, 1, 2, 3, 4, 5, 10, 11, 8, 9, 18, 19, 13, 15, 12, 14, 16, 17, 22, 23, 20, 21, 6, 7 }, // DI
+		{ 0, 18, 2, 16, 4, 1, 6, 3, 9, 11, 8, 10, 12, 5, 14, 7, 15, 17, 13, 19, 20, 21, 22, 23 }, // RI
+		{ 4, 1, 6, 3, 12, 5, 14, 7, 8, 9, 10, 11, 19, 13, 17, 15, 16, 2, 18, 0, 21, 23, 20, 22 }, // LI
+		{ 0, 1, 8, 10, 5, 7, 4, 6, 13, 9, 12, 11, 21, 23, 14, 15, 16, 17, 18, 19, 20, 3, 22, 2 }, // FI
+		{ 22, 20, 2, 3, 4, 5, 6, 7, 8, 0, 10, 1, 12, 13, 11, 9, 17, 19, 16, 18, 14, 21, 15, 23 }, // BI
+		{ 3, 2, 1, 0, 16, 17, 6, 7, 20, 21, 10, 11, 12, 13, 14, 15, 4, 5, 18, 19, 8, 9, 22, 23 }, // U2
+		{ 0, 1, 2, 3, 4, 5, 18, 19, 8, 9, 22, 23, 15, 14, 13, 12, 16, 17, 6, 7, 20, 21, 10, 11 }, // D2
+		{ 0, 13, 2, 15, 4, 18, 6, 16, 11, 10, 9, 8, 12, 1, 14, 3, 7, 17, 5, 19, 20, 21, 22, 23 }, // R2
+		{ 12, 1, 14, 3, 19, 5, 17, 7, 8, 9, 10, 11, 0, 13, 2, 15, 16, 6, 18, 4, 23, 22, 21, 20 }, // L2
+		{ 0, 1, 13, 12, 7, 6, 5, 4, 23, 9, 21, 11, 3, 2, 14, 15, 16, 17, 18, 19, 20, 10, 22, 8 }, // F2
+		{ 15, 14, 2, 3, 4, 5, 6, 7, 8, 22, 10, 20, 12, 13, 1, 0, 19, 18, 17, 16, 11, 21, 9, 23 }  // B2
+	} };
+
+	/// <summary>
+	/// Whether every row of moveFacelets is a turn of a real cube: the three stickers of each
+	/// corner land together on one corner in the same cyclic order, a quarter turn has order 4
+	/// and its inverse undoes it, and a half turn is its quarter turn applied twice. Checked at
+	/// compile time below the class.
+	/// </summary>
+	static constexpr bool movesAreCubeMoves() {
+		Facelets identity{};
+		for (int i = 0; i < FaceletCount; ++i) {
+			identity[i] = (uint8_t)i;
+		}
+		auto then = [](const Facelets& first, const Facelets& second) {
+			Facelets result{};
+			for (int i = 0; i < FaceletCount; ++i) {
+				result[i] = first[second[i]];
+			}
+			return result;
+		};
+
+		for (int r = 0; r < RotationCount; ++r) {
+			const Facelets& perm = moveFacelets[r];
+			for (const auto& corner : cornerFacelets) {
+				const int source = perm[corner[0]];
+				bool together = false;
+				for (const auto& from : cornerFacelets) {
+					for (int k = 0; k < 3; ++k) {
+						if (from[k] == source) {
+							together = perm[corner[1]] == from[(k + 1) % 3] && perm[corner[2]] == from[(k + 2) % 3];
+						}
+					}
+				}
+				if (!together) {
+					return false;
+				}
+			}
+		}
+
+		for (int face = 0; face < 6; ++face) {
+			const Facelets& quarter = moveFacelets[face];
+			const Facelets twice = then(quarter, quarter);
+			if (twice == identity || then(twice, twice) != identity) {
+				return false;
+			}
+			if (then(quarter, moveFacelets[face + 6]) != identity) {
+				return false;
+			}
+			if (moveFacelets[face + 12] != twice) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Color of a facelet
+	/// </summary>
+	/// <param name="idx">Facelet index (face * 4 + row * 2 + col)</param>
+	/// <returns>Color</returns>
+	Color getFacelet(int idx) const {
+		return _matrix[idx / 4][(idx % 4) / 2][idx % 2];
+	}
+
+	/// <summary>
+	/// Set the color of a facelet
+	/// </summary>
+	/// <param name="idx">Facelet index (face * 4 + row * 2 + col)</param>
+	/// <param name="color">Color</param>
+	void setFacelet(int idx, Color color) {
+		_matrix[idx / 4][(idx % 4) / 2][idx % 2] = color;
+	}
+
+	/// <summary>
+	/// Read all stickers into the flat facelet form
+	/// </summary>
+	/// <returns>Facelets</returns>
+	Facelets getFacelets() const {
+		Facelets facelets;
+		for (int i = 0; i < FaceletCount; ++i) {
+			facelets[i] = (uint8_t)getFacelet(i);
+		}
+		return facelets;
+	}
+
+	/// <summary>
+	/// Write all stickers from the flat facelet form
+	/// </summary>
+	/// <param name="facelets">Facelets</param>
+	void setFacelets(const Facelets& facelets) {
+		for (int i = 0; i < FaceletCount; ++i) {
+			setFacelet(i, (Color)facelets[i]);
+		}
+	}
+
+	/// <summary>
+	/// Apply a facelet permutation: facelet i of the result is facelet perm[i] of the input
+	/// </summary>
+	/// <param name="facelets">Facelets</param>
+	/// <param name="perm">Permutation in the moveFacelets form</param>
+	/// <returns>Permuted facelets</returns>
+	static Facelets permute(const Facelets& facelets, const Facelets& perm) {
+		Facelets result;
+		for (int i = 0; i < FaceletCount; ++i) {
+			result[i] = facelets[perm[i]];
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Facelet permutation of a move sequence, in the moveFacelets form, built two moves at a
+	/// time from the table of move pairs
+	/// </summary>
+	/// <param name="moves">Moves</param>
+	/// <returns>Permutation that applies all the moves at once</returns>
+	static Facelets composeMoves(const std::vector<Rotation>& moves) {
+		Facelets perm;
+		for (int i = 0; i < FaceletCount; ++i) {
+			perm[i] = (uint8_t)i;
+		}
+		size_t m = 0;
+		for (; m + 1 < moves.size(); m += 2) {
+			perm = permute(perm, movePairFacelets[moves[m]][moves[m + 1]]);
+		}
+		if (m < moves.size()) {
+			perm = permute(perm, moveFacelets[moves[m]]);
+		}
+		return perm;
+	}
+
+	using Cube::isSolved;
+
+	/// <summary>
+	/// Whether every face is of one color
+	/// </summary>
+	static bool isSolved(const Facelets& facelets) {
+		for (int f = 0; f < FaceletCount; f += 4) {
+			if (facelets[f + 1] != facelets[f] || facelets[f + 2] != facelets[f] || facelets[f + 3] != facelets[f]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Check a solution without a cube: the moves are composed and applied to the state once,
+	/// with nothing logged and nothing allocated
+	/// </summary>
+	/// <param name="facelets">State, in any color scheme</param>
+	/// <param name="moves">Solution</param>
+	/// <returns>True if the moves solve the state</returns>
+	static bool verify(const Facelets& facelets, const std::vector<Rotation>& moves) {
+		return isSolved(permute(facelets, composeMoves(moves)));
+	}
+
+	/// <summary>
+	/// Identify the corner cubies against the init state color scheme
+	/// </summary>
+	/// <param name="facelets">Facelets</param>
+	/// <param name="cp">Cubie at each corner position</param>
+	/// <param name="co">Twist of each corner: index of the U/D sticker in the position's facelets</param>
+	/// <returns>False if a corner has a color combination that does not exist in the scheme</returns>
+	static bool cornersFromFacelets(const Facelets& facelets, std::array<uint8_t, CornerCount>& cp, std::array<uint8_t, CornerCount>& co) {
+		for (int pos = 0; pos < CornerCount; ++pos) {
+			const auto& corner = cornerFacelets[pos];
+			const uint8_t cubieTwist = cornerLookup[cornerKey(facelets[corner[0]], facelets[corner[1]], facelets[corner[2]])];
+			if (cubieTwist == 0xFF) {
+				return false;
+			}
+			cp[pos] = cubieTwist / 3;
+			co[pos] = cubieTwist % 3;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Identify the corner cubies of this cube
+	/// </summary>
+	/// <param name="cp">Cubie at each corner position</param>
+	/// <param name="co">Twist of each corner</param>
+	/// <returns>False if a corner has a color combination that does not exist in the scheme</returns>
+	bool getCorners(std::array<uint8_t, CornerCount>& cp, std::array<uint8_t, CornerCount>& co) const {
+		return cornersFromFacelets(getFacelets(), cp, co);
+	}
+
+	/// <summary>
+	/// Place the corner cubies, painting them in the init state color scheme
+	/// </summary>
+	/// <param name="cp">Cubie at each corner position</param>
+	/// <param name="co">Twist of each corner</param>
+	void setCorners(const std::array<uint8_t, CornerCount>& cp, const std::array<uint8_t, CornerCount>& co) {
+		for (int pos = 0; pos < CornerCount; ++pos) {
+			for (int k = 0; k < 3; ++k) {
+				setFacelet(cornerFacelets[pos][(k + co[pos]) % 3], cornerColor(cp[pos], k));
+			}
+		}
+	}
+
+	/// <summary>
+	/// Perfect index of a cube state: Lehmer rank of the corner permutation times 3^7
+	/// plus the rank of the corner twists
+	/// </summary>
+	/// <param name="facelets">Facelets</param>
+	/// <returns>Index in [0, StateCount), or InvalidState if the corners cannot be identified</returns>
+	static uint32_t encodeFacelets(const Facelets& facelets) {
+		std::array<uint8_t, CornerCount> cp;
+		std::array<uint8_t, CornerCount> co;
+		if (!cornersFromFacelets(facelets, cp, co)) {
+			return InvalidState;
+		}
+		return (uint32_t)Lehmer::rankPermutation(cp) * (uint32_t)Lehmer::power(3, CornerCount - 1) + Lehmer::rankOrientation(co, 3);
+	}
+
+	/// <summary>
+	/// Perfect index of this cube's state, see encodeFacelets
+	/// </summary>
+	/// <returns>Index in [0, StateCount), or InvalidState if the corners cannot be identified</returns>
+	uint32_t encode() const {
+		return encodeFacelets(getFacelets());
+	}
+
+	/// <summary>
+	/// Inverse of encode
+	/// </summary>
+	/// <param name="index">Index in [0, StateCount)</param>
+	void decode(uint32_t index) {
+		std::array<uint8_t, CornerCount> cp;
+		std::array<uint8_t, CornerCount> co;
+		const uint32_t oriCount = (uint32_t)Lehmer::power(3, CornerCount - 1);
+		Lehmer::unrankPermutation(index / oriCount, cp);
+		Lehmer::unrankOrientation(index % oriCount, 3, co);
+		setCorners(cp, co);
+	}
+
+	/// <summary>
+	/// Check that the stickers form a solvable cube. Runs in constant time: it counts the
+	/// colors, works out the color scheme from the corners, identifies every corner cubie
+	/// and checks the twist sum. A 2x2x2 has no permutation parity constraint (a quarter
+	/// turn is a 4-cycle of corners, so both parities are reachable).
+	/// </summary>
+	/// <returns>VALID, or the first problem found</returns>
+	ValidationResult validate() const {
+		const Facelets facelets = getFacelets();
+
+		std::array<int, 6> counts = {};
+		for (int i = 0; i < FaceletCount; ++i) {
+			if (facelets[i] >= UNDEFINED) {
+				return { INVALID_COLOR, "Sticker " + std::to_string(i) + " has an unknown color." };
+			}
+			++counts[facelets[i]];
+		}
+		for (int c = 0; c < 6; ++c) {
+			if (counts[c] != 4) {
+				return { WRONG_COLOR_COUNT, colorToString((Color)c) + " appears " + std::to_string(counts[c]) + " times, expected 4." };
+			}
+		}
+
+		std::array<Color, 6> faceColors;
+		if (!detectScheme(facelets, faceColors)) {
+			return { INVALID_CORNER, "A corner has a repeated color or two colors of opposite faces." };
+		}
+
+		std::array<uint8_t, CornerCount> cp;
+		std::array<uint8_t, CornerCount> co;
+		if (!cornersFromFacelets(relabel(facelets, faceColors), cp, co)) {
+			return { INVALID_CORNER, "A corner has its colors in mirror image order." };
+		}
+
+		uint32_t seen = 0;
+		int twist = 0;
+		for (int pos = 0; pos < CornerCount; ++pos) {
+			if (seen & (1u << cp[pos])) {
+				return { DUPLICATE_CORNER, "The same corner cubie appears twice." };
+			}
+			seen |= 1u << cp[pos];
+			twist += co[pos];
+		}
+		if (twist % 3 != 0) {
+			return { TWISTED_CORNER, "A corner is twisted in place." };
+		}
+
+		return { VALID, "" };
+	}
+
+	/// <summary>
+	/// Work out the color of every face from the stickers: two colors that never share a
+	/// corner are on opposite faces, and the DBL corner (never moved by U, R and F) fixes
+	/// which color is on which face
+	/// </summary>
+	/// <param name="facelets">Facelets</param>
+	/// <param name="faceColors">Color of each face, indexed by Faces</param>
+	/// <returns>False if the corners do not pair the colors into three opposite faces</returns>
+	static bool detectScheme(const Facelets& facelets, std::array<Color, 6>& faceColors) {
+		std::array<uint32_t, 6> adjacent = {};
+		for (const auto& corner : cornerFacelets) {
+			for (int k = 0; k < 3; ++k) {
+				const uint8_t color = facelets[corner[k]];
+				const uint8_t next = facelets[corner[(k + 1) % 3]];
+				if (color >= UNDEFINED || next >= UNDEFINED || color == next) {
+					return false;
+				}
+				adjacent[color] |= 1u << next;
+				adjacent[next] |= 1u << color;
+			}
+		}
+
+		std::array<Color, 6> opposite;
+		for (int c = 0; c < 6; ++c) {
+			const uint32_t apart = ~adjacent[c] & ~(1u << c) & 0x3F;
+			if (apart == 0 || (apart & (apart - 1)) != 0) {
+				return false;
+			}
+			opposite[c] = (Color)std::countr_zero(apart);
+		}
+
+		faceColors = schemeFromFixedCorner(facelets, opposite);
+		return true;
+	}
+
+	/// <summary>
+	/// Face colors implied by the DBL corner: its stickers give the BOTTOM, BACK and LEFT
+	/// colors, and the opposite faces get the opposite colors
+	/// </summary>
+	/// <param name="facelets">Facelets, the DBL stickers must have known colors</param>
+	/// <param name="opposite">Opposite color of each color</param>
+	/// <returns>Color of each face, indexed by Faces</returns>
+	static std::array<Color, 6> schemeFromFixedCorner(const Facelets& facelets, const std::array<Color, 6>& opposite) {
+		const auto& dbl = cornerFacelets[6];
+		std::array<Color, 6> faceColors;
+		faceColors[BOTTOM] = (Color)facelets[dbl[0]];
+		faceColors[BACK] = (Color)facelets[dbl[1]];
+		faceColors[LEFT] = (Color)facelets[dbl[2]];
+		faceColors[TOP] = opposite[faceColors[BOTTOM]];
+		faceColors[FRONT] = opposite[faceColors[BACK]];
+		faceColors[RIGHT] = opposite[faceColors[LEFT]];
+		return faceColors;
+	}
+
+	/// <summary>
+	/// Relabel the stickers into the init state color scheme, whatever colors the cube uses and
+	/// however it is held: the corner at DBL is taken as the fixed corner and painted WHITE,
+	/// GREEN, ORANGE. A solved cube in any orientation becomes the init state, and the search
+	/// only needs the moves that keep DBL in place.
+	/// </summary>
+	/// <returns>False if the color scheme cannot be worked out (see validate)</returns>
+	bool normalizeOrientation() {
+		const Facelets facelets = getFacelets();
+		std::array<Color, 6> faceColors;
+		if (!detectScheme(facelets, faceColors)) {
+			return false;
+		}
+		setFacelets(relabel(facelets, faceColors));
+		return true;
+	}
+
+	/// <summary>
+	/// Repaint stickers from the given face colors into the init state color scheme
+	/// </summary>
+	/// <param name="facelets">Facelets</param>
+	/// <param name="faceColors">Current color of each face, indexed by Faces</param>
+	/// <returns>Relabeled facelets</returns>
+	static Facelets relabel(const Facelets& facelets, const std::array<Color, 6>& faceColors) {
+		std::array<uint8_t, 7> map = { UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED, UNDEFINED };
+		for (int f = 0; f < 6; ++f) {
+			map[faceColors[f]] = (uint8_t)initFaceColors[f];
+		}
+		Facelets result;
+		for (int i = 0; i < FaceletCount; ++i) {
+			result[i] = map[facelets[i]];
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Make a rotation
+	/// </summary>
+	/// <param name="r">Rotation</param>
+	void applyRotation(Rotation r) override {
+		setFacelets(permute(getFacelets(), moveFacelets[r]));
+		Cube::applyRotation(r);
+	}
+
+protected:
+	/// <summary>
+	/// With the DBL corner fixed by normalizeOrientation, turning U, R and F reaches every state
+	/// </summary>
+	const std::vector<Rotation>& searchRotations(Metric metric) const override {
+		static const std::vector<Rotation> quarterTurns = { U, R, F, UI, RI, FI };
+		static const std::vector<Rotation> faceTurns = { U, R, F, UI, RI, FI, U2, R2, F2 };
+		return metric == HALF_TURN ? faceTurns : quarterTurns;
+	}
+
+	/// <summary>
+	/// Init state color of the k-th sticker of a corner cubie
+	/// </summary>
+	static constexpr Color cornerColor(int cubie, int k) {
+		return initFaceColors[cornerFacelets[cubie][k] / 4];
+	}
+
+	static constexpr int cornerKey(int c0, int c1, int c2) {
+		return (c0 * 7 + c1) * 7 + c2;
+	}
+
+	/// <summary>
+	/// cubie * 3 + twist for every color triple read from a corner position, 0xFF if no cubie has those colors
+	/// </summary>
+	static const std::array<uint8_t, 7 * 7 * 7> cornerLookup;
+
+	/// <summary>
+	/// Permutation of every pair of moves, the first then the second
+	/// </summary>
+	static const std::array<std::array<Facelets, RotationCount>, RotationCount> movePairFacelets;
+
+	static constexpr std::array<std::array<Facelets, RotationCount>, RotationCount> buildMovePairs() {
+		std::array<std::array<Facelets, RotationCount>, RotationCount> pairs{};
+		for (int first = 0; first < RotationCount; ++first) {
+			for (int second = 0; second < RotationCount; ++second) {
+				for (int i = 0; i < FaceletCount; ++i) {
+					pairs[first][second][i] = moveFacelets[first][moveFacelets[second][i]];
+				}
+			}
+		}
+		return pairs;
+	}
+
+	static constexpr std::array<uint8_t, 7 * 7 * 7> buildCornerLookup() {
+		std::array<uint8_t, 7 * 7 * 7> lookup{};
+		lookup.fill(0xFF);
+		for (int cubie = 0; cubie < CornerCount; ++cubie) {
+			for (int twist = 0; twist < 3; ++twist) {
+				// With twist t the cubie's U/D sticker sits on the position's facelet t
+				const Color c0 = cornerColor(cubie, (3 - twist) % 3);
+				const Color c1 = cornerColor(cubie, (4 - twist) % 3);
+				const Color c2 = cornerColor(cubie, (5 - twist) % 3);
+				lookup[cornerKey(c0, c1, c2)] = (uint8_t)(cubie * 3 + twist);
+			}
+		}
+		return lookup;
+	}
+};
+
+inline constexpr std::array<uint8_t, 7 * 7 * 7> Cube222::cornerLookup = Cube222::buildCornerLookup();
+inline constexpr std::array<std::array<Cube222::Facelets, Cube222::RotationCount>, Cube222::RotationCount> Cube222::movePairFacelets = Cube222::buildMovePairs();
+
+static_assert(Cube222::movesAreCubeMoves(), "Cube222::moveFacelets holds a permutation that is not a cube move");
@@ -0,0 +1,266 @@
+﻿// CubeBatch.h : 32 Cube222 states side by side, one byte per cube per sticker
+//
+// Bulk work (checking a batch's solutions, generating a corpus) does the same
+// thing to many independent cubes. Stored structure-of-arrays, sticker i of all
+// 32 cubes is one 32-byte row, so a move is a copy of the 12 rows it moves
+// whatever the number of cubes, and the solved test is a compare of the rows of
+// each face. A move can be limited to some of the cubes by a lane mask, which
+// blends the moved rows with the old ones; that lets every cube follow its own
+// move sequence. Built with AVX2 (cmake -DRUBIKS_AVX2=ON) a row is one
+// register; otherwise the rows are handled as four 64-bit words, eight cubes to
+// a word.
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "Cube.h"
+#include "Macro.h"
+
+class CubeBatch {
+public:
+	using Facelets = Cube222::Facelets;
+
+	static constexpr int Lanes = 32;
+
+	/// <summary>
+	/// Every lane in the init state
+	/// </summary>
+	CubeBatch() {
+		fill(Cube222().getFacelets());
+	}
+
+	void fill(const Facelets& facelets) {
+		for (int i = 0; i < Cube222::FaceletCount; ++i) {
+			std::memset(_rows[i].data(), facelets[i], Lanes);
+		}
+	}
+
+	void set(int lane, const Facelets& facelets) {
+		for (int i = 0; i < Cube222::FaceletCount; ++i) {
+			_rows[i][lane] = facelets[i];
+		}
+	}
+
+	Facelets get(int lane) const {
+		Facelets facelets;
+		for (int i = 0; i < Cube222::FaceletCount; ++i) {
+			facelets[i] = _rows[i][lane];
+		}
+		return facelets;
+	}
+
+	/// <summary>
+	/// Apply a move to every lane
+	/// </summary>
+	void apply(Rotation r) {
+		permuteRows(Cube222::moveFacelets[r], movedRows(r));
+	}
+
+	/// <summary>
+	/// Apply a move sequence to every lane, composed into a single permutation first
+	/// </summary>
+	void apply(const std::vector<Rotation>& moves) {
+		apply(MoveMacro(moves));
+	}
+
+	/// <summary>
+	/// Apply a compiled move sequence to every lane
+	/// </summary>
+	void apply(const MoveMacro& macro) {
+		permuteRows(macro.permutation(), MovedRows(macro.permutation()));
+	}
+
+	/// <summary>
+	/// Apply a move to the lanes set in a mask, leaving the others as they are
+	/// </summary>
+	/// <param name="r">Move</param>
+	/// <param name="lanes">Bit l for lane l</param>
+	void apply(Rotation r, uint32_t lanes) {
+		if (lanes == UINT32_MAX) {
+			apply(r);
+			return;
+		}
+		alignas(32) Row mask;
+		for (int l = 0; l < Lanes; ++l) {
+			mask[l] = (lanes >> l) & 1 ? 0xFF : 0;
+		}
+		const Facelets& perm = Cube222::moveFacelets[r];
+		const MovedRows& moved = movedRows(r);
+		alignas(32) Rows blended;
+		for (int k = 0; k < moved.count; ++k) {
+			blend(blended[k], _rows[perm[moved.rows[k]]], _rows[moved.rows[k]], mask);
+		}
+		for (int k = 0; k < moved.count; ++k) {
+			_rows[moved.rows[k]] = blended[k];
+		}
+	}
+
+	/// <summary>
+	/// Apply a move sequence of its own to each lane: step by step, each move once for all the
+	/// lanes that make it at that step
+	/// </summary>
+	/// <param name="sequences">Moves of lane l at sequences[l]</param>
+	/// <param name="count">Number of sequences, at most Lanes</param>
+	void applyEach(const std::vector<Rotation>* sequences, int count) {
+		size_t longest = 0;
+		for (int l = 0; l < count; ++l) {
+			longest = std::max(longest, sequences[l].size());
+		}
+		for (size_t step = 0; step < longest; ++step) {
+			std::array<uint32_t, B2 + 1> lanes = {};
+			for (int l = 0; l < count; ++l) {
+				if (step < sequences[l].size()) {
+					lanes[sequences[l][step]] |= uint32_t(1) << l;
+				}
+			}
+			for (int r = 0; r <= B2; ++r) {
+				if (lanes[r] != 0) {
+					apply((Rotation)r, lanes[r]);
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// Lanes whose faces are each of one color
+	/// </summary>
+	/// <returns>Bit l for lane l</returns>
+	uint32_t solvedMask() const {
+		const Rows& current = _rows;
+#ifdef __AVX2__
+		__m256i same = _mm256_set1_epi8(-1);
+		for (int f = 0; f < Cube222::FaceletCount; f += 4) {
+			const __m256i first = load(current[f]);
+			for (int k = 1; k < 4; ++k) {
+				same = _mm256_and_si256(same, _mm256_cmpeq_epi8(first, load(current[f + k])));
+			}
+		}
+		return (uint32_t)_mm256_movemask_epi8(same);
+#else
+		// A byte of differ stays 0 while its lane has matched on every face
+		uint32_t mask = 0;
+		for (int w = 0; w < Lanes / 8; ++w) {
+			uint64_t differ = 0;
+			for (int f = 0; f < Cube222::FaceletCount; f += 4) {
+				const uint64_t first = word(current[f], w);
+				for (int k = 1; k < 4; ++k) {
+					differ |= first ^ word(current[f + k], w);
+				}
+			}
+			for (int b = 0; b < 8; ++b) {
+				mask |= ((differ >> (b * 8)) & 0xFF) == 0 ? uint32_t(1) << (w * 8 + b) : 0;
+			}
+		}
+		return mask;
+#endif
+	}
+
+	/// <summary>
+	/// Check that each solution solves its state, Lanes states at a time
+	/// </summary>
+	/// <param name="states">States</param>
+	/// <param name="solutions">Moves for each state</param>
+	/// <returns>Indices of the states a solution leaves unsolved</returns>
+	static std::vector<size_t> checkSolutions(const std::vector<Facelets>& states, const std::vector<std::vector<Rotation>>& solutions) {
+		std::vector<size_t> failures;
+		for (size_t first = 0; first < states.size(); first += Lanes) {
+			const size_t count = std::min<size_t>(Lanes, states.size() - first);
+			CubeBatch batch;
+			for (size_t l = 0; l < count; ++l) {
+				batch.set((int)l, states[first + l]);
+			}
+			batch.applyEach(solutions.data() + first, (int)count);
+			const uint32_t solved = batch.solvedMask();
+			for (size_t l = 0; l < count; ++l) {
+				if (((solved >> l) & 1) == 0) {
+					failures.push_back(first + l);
+				}
+			}
+		}
+		return failures;
+	}
+
+private:
+	using Row = std::array<uint8_t, Lanes>;
+	using Rows = std::array<Row, Cube222::FaceletCount>;
+
+	alignas(32) Rows _rows;
+
+	/// <summary>
+	/// The rows a permutation changes, the others stay where they are
+	/// </summary>
+	struct MovedRows {
+		std::array<uint8_t, Cube222::FaceletCount> rows;
+		int count = 0;
+
+		MovedRows() = default;
+
+		MovedRows(const Facelets& perm) {
+			for (int i = 0; i < Cube222::FaceletCount; ++i) {
+				if (perm[i] != i) {
+					rows[count++] = (uint8_t)i;
+				}
+			}
+		}
+	};
+
+	static const MovedRows& movedRows(Rotation r) {
+		static const std::array<MovedRows, B2 + 1> table = []() {
+			std::array<MovedRows, B2 + 1> moved;
+			for (int m = 0; m <= B2; ++m) {
+				moved[m] = MovedRows(Cube222::moveFacelets[m]);
+			}
+			return moved;
+		}();
+		return table[r];
+	}
+
+	/// <summary>
+	/// Row i of the result is row perm[i], in every lane
+	/// </summary>
+	void permuteRows(const Facelets& perm, const MovedRows& moved) {
+		alignas(32) Rows from;
+		for (int k = 0; k < moved.count; ++k) {
+			from[k] = _rows[perm[moved.rows[k]]];
+		}
+		for (int k = 0; k < moved.count; ++k) {
+			_rows[moved.rows[k]] = from[k];
+		}
+	}
+
+	/// <summary>
+	/// Bytes of moved where mask is set, of kept elsewhere
+	/// </summary>
+	static void blend(Row& out, const Row& moved, const Row& kept, const Row& mask) {
+#ifdef __AVX2__
+		_mm256_store_si256(reinterpret_cast<__m256i*>(out.data()), _mm256_blendv_epi8(load(kept), load(moved), load(mask)));
+#else
+		for (int w = 0; w < Lanes / 8; ++w) {
+			const uint64_t m = word(mask, w);
+			const uint64_t value = (word(moved, w) & m) | (word(kept, w) & ~m);
+			std::memcpy(out.data() + w * 8, &value, sizeof(value));
+		}
+#endif
+	}
+
+#ifdef __AVX2__
+	static __m256i load(const Row& row) {
+		return _mm256_load_si256(reinterpret_cast<const __m256i*>(row.data()));
+	}
+#else
+	static uint64_t word(const Row& row, int w) {
+		uint64_t value;
+		std::memcpy(&value, row.data() + w * 8, sizeof(value));
+		return value;
+	}
+#endif
+};
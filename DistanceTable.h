@@ -0,0 +1,411 @@
+﻿// DistanceTable.h : Full Cube222 distance table, built breadth first on several threads
+//
+// Every state with the DBL corner fixed gets an index from the permutation of
+// the seven other corners (5040) and the twists of six of them (729), and a
+// 4-bit entry holding its distance from solved (15 while unreached), sixteen
+// entries to a 64-bit word: 3674160 states in 1.8 MB. Each breadth first level
+// is split into chunks of words that the threads take in turn. A thread expands
+// the entries at the current depth through cubie level move tables and marks
+// unreached children with the next depth by compare-and-swap on the word. All
+// writers of a level write the same value, so the table does not depend on the
+// thread count or the order the chunks run in: it is byte-identical to a
+// single-threaded build. A checkpointed build saves the table after every
+// level; the levels are in the table itself, so a resumed build loads it and
+// goes on from the deepest one.
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <array>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include "Cube.h"
+#include "Checkpoint.h"
+
+/// <summary>
+/// Dense index of the states with the DBL corner fixed, and its move tables
+/// </summary>
+class CornerIndex {
+public:
+	using Facelets = Cube222::Facelets;
+
+	static constexpr int FreeCorners = Cube222::CornerCount - 1;
+	static constexpr uint32_t PermutationCount = 5040;
+	static constexpr uint32_t TwistCount = 729;
+	static constexpr uint32_t Size = PermutationCount * TwistCount;
+
+	// The quarter turns, then the half turns used in the half turn metric
+	static constexpr int MoveCount = 9;
+	static constexpr int QuarterTurnCount = 6;
+	static constexpr std::array<Rotation, MoveCount> moves = { U, R, F, UI, RI, FI, U2, R2, F2 };
+
+	/// <summary>
+	/// The shared move tables
+	/// </summary>
+	static const CornerIndex& instance() {
+		static const CornerIndex index;
+		return index;
+	}
+
+	static int moveCount(Metric metric) {
+		return metric == HALF_TURN ? MoveCount : QuarterTurnCount;
+	}
+
+	/// <summary>
+	/// Index reached from an index by moves[m]
+	/// </summary>
+	uint32_t move(uint32_t index, int m) const {
+		return _permMove[index / TwistCount][m] * TwistCount + _twistMove[index % TwistCount][m];
+	}
+
+	/// <summary>
+	/// Index of a state: permutation rank of the seven free corners, then the twists of six of them
+	/// </summary>
+	/// <returns>Index, Size if the state is not valid or the DBL corner is not in place</returns>
+	static uint32_t indexOf(const Facelets& facelets) {
+		std::array<uint8_t, Cube222::CornerCount> cp;
+		std::array<uint8_t, Cube222::CornerCount> co;
+		if (!Cube222::cornersFromFacelets(facelets, cp, co) || cp[FixedCorner] != FixedCorner || co[FixedCorner] != 0) {
+			return Size;
+		}
+		return indexOf(cp, co);
+	}
+
+private:
+	static constexpr int FixedCorner = 6;
+	static constexpr std::array<uint8_t, FreeCorners> freeCorners = { 0, 1, 2, 3, 4, 5, 7 };
+
+	std::array<std::array<uint16_t, MoveCount>, PermutationCount> _permMove;
+	std::array<std::array<uint16_t, MoveCount>, TwistCount> _twistMove;
+
+	static uint32_t indexOf(const std::array<uint8_t, Cube222::CornerCount>& cp, const std::array<uint8_t, Cube222::CornerCount>& co) {
+		std::array<uint8_t, FreeCorners> perm;
+		std::array<uint8_t, FreeCorners> twist;
+		for (int i = 0; i < FreeCorners; ++i) {
+			perm[i] = (uint8_t)(std::find(freeCorners.begin(), freeCorners.end(), cp[freeCorners[i]]) - freeCorners.begin());
+			twist[i] = co[freeCorners[i]];
+		}
+		return (uint32_t)Lehmer::rankPermutation(perm) * TwistCount + Lehmer::rankOrientation(twist, 3);
+	}
+
+	/// <summary>
+	/// Cubie level move tables from the facelet moves, as in TwoPhaseSolver
+	/// </summary>
+	CornerIndex() {
+		const Facelets solved = Cube222().getFacelets();
+		for (int m = 0; m < MoveCount; ++m) {
+			// Every move keeps the corners whole (Cube222::movesAreCubeMoves), so all of them are found
+			std::array<uint8_t, Cube222::CornerCount> moveCp = {};
+			std::array<uint8_t, Cube222::CornerCount> moveCo = {};
+			Cube222::cornersFromFacelets(Cube222::permute(solved, Cube222::moveFacelets[moves[m]]), moveCp, moveCo);
+
+			for (uint32_t p = 0; p < PermutationCount; ++p) {
+				std::array<uint8_t, FreeCorners> perm;
+				Lehmer::unrankPermutation(p, perm);
+				std::array<uint8_t, Cube222::CornerCount> cp;
+				std::array<uint8_t, Cube222::CornerCount> moved;
+				std::array<uint8_t, Cube222::CornerCount> co = {};
+				cp[FixedCorner] = FixedCorner;
+				for (int i = 0; i < FreeCorners; ++i) {
+					cp[freeCorners[i]] = freeCorners[perm[i]];
+				}
+				for (int i = 0; i < Cube222::CornerCount; ++i) {
+					moved[i] = cp[moveCp[i]];
+				}
+				_permMove[p][m] = (uint16_t)(indexOf(moved, co) / TwistCount);
+			}
+
+			for (uint32_t t = 0; t < TwistCount; ++t) {
+				std::array<uint8_t, FreeCorners> twist;
+				Lehmer::unrankOrientation(t, 3, twist);
+				std::array<uint8_t, Cube222::CornerCount> co;
+				std::array<uint8_t, Cube222::CornerCount> moved;
+				std::array<uint8_t, Cube222::CornerCount> cp;
+				co[FixedCorner] = 0;
+				for (int i = 0; i < FreeCorners; ++i) {
+					co[freeCorners[i]] = twist[i];
+				}
+				for (int i = 0; i < Cube222::CornerCount; ++i) {
+					moved[i] = (uint8_t)((co[moveCp[i]] + moveCo[i]) % 3);
+					cp[i] = (uint8_t)i;
+				}
+				_twistMove[t][m] = (uint16_t)(indexOf(cp, moved) % TwistCount);
+			}
+		}
+	}
+};
+
+class DistanceTable {
+public:
+	using Facelets = Cube222::Facelets;
+
+	static constexpr uint32_t Size = CornerIndex::Size;
+	static constexpr uint8_t Unreached = 0xF;
+	static constexpr int EntriesPerWord = 16;
+	static constexpr size_t WordCount = (Size + EntriesPerWord - 1) / EntriesPerWord;
+
+	DistanceTable() : _words(WordCount) {
+	}
+
+	/// <summary>
+	/// Breadth first search from the solved state over all the states with the DBL corner fixed
+	/// </summary>
+	/// <param name="metric">Quarter turns only, or quarter and half turns</param>
+	/// <param name="threads">Worker threads, 1 builds on the calling thread</param>
+	/// <param name="checkpoint">File the table is saved to after every level, empty for none</param>
+	/// <param name="resume">Go on from the levels in the checkpoint, if it holds a build in this metric</param>
+	void build(Metric metric = QUARTER_TURN, int threads = 1, const std::string& checkpoint = "", bool resume = false) {
+		if (resume && std::filesystem::exists(checkpoint) && load(checkpoint, metric)) {
+			std::cout << "Resuming the table build at depth " << _levels.size() - 1 << ".\n";
+		}
+		else {
+			_metric = metric;
+			for (auto& word : _words) {
+				word.store(~uint64_t(0), std::memory_order_relaxed);
+			}
+			set(0, 0);
+			_levels = { 1 };
+		}
+
+		for (int depth = (int)_levels.size() - 1; _levels.back() > 0; ++depth) {
+			std::atomic<size_t> nextChunk = 0;
+			std::vector<uint64_t> found(std::max(1, threads));
+			auto expand = [&](int worker) {
+				for (size_t chunk = nextChunk++; chunk * ChunkWords < WordCount; chunk = nextChunk++) {
+					found[worker] += expandChunk(chunk, depth);
+				}
+			};
+
+			std::vector<std::thread> workers;
+			for (int t = 1; t < threads; ++t) {
+				workers.emplace_back(expand, t);
+			}
+			expand(0);
+			for (std::thread& worker : workers) {
+				worker.join();
+			}
+
+			uint64_t total = 0;
+			for (uint64_t count : found) {
+				total += count;
+			}
+			_levels.push_back(total);
+			if (!checkpoint.empty()) {
+				save(checkpoint);
+			}
+		}
+		_levels.pop_back();
+	}
+
+	/// <summary>
+	/// Whether level counts can come from a build in a metric: one solved state, and as many
+	/// states one move away as there are moves
+	/// </summary>
+	static bool levelsFit(const std::vector<uint64_t>& levels, Metric metric) {
+		return !levels.empty() && levels[0] == 1 && (levels.size() < 2 || levels[1] == (uint64_t)CornerIndex::moveCount(metric));
+	}
+
+	/// <summary>
+	/// Distance of an index
+	/// </summary>
+	int distance(uint32_t index) const {
+		const int d = get(index);
+		return d == Unreached ? -1 : d;
+	}
+
+	/// <summary>
+	/// Distance of a state in the table's metric
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme with the DBL corner fixed</param>
+	/// <returns>Distance to solved, -1 if the state is not valid or not normalized</returns>
+	int distance(const Facelets& facelets) const {
+		const uint32_t index = CornerIndex::indexOf(facelets);
+		return index == Size ? -1 : distance(index);
+	}
+
+	/// <summary>
+	/// Optimal solution: from each state take a move to a state one closer
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme with the DBL corner fixed</param>
+	/// <param name="solution">Moves</param>
+	/// <returns>False if the state is not in the table, or the table has no way down from it</returns>
+	bool solve(const Facelets& facelets, std::vector<Rotation>& solution) const {
+		const CornerIndex& corners = CornerIndex::instance();
+		solution.clear();
+		uint32_t index = CornerIndex::indexOf(facelets);
+		if (index == Size || get(index) == Unreached) {
+			return false;
+		}
+		for (int d = get(index); d > 0; --d) {
+			bool descended = false;
+			for (int m = 0; m < CornerIndex::moveCount(_metric) && !descended; ++m) {
+				const uint32_t child = corners.move(index, m);
+				if (get(child) == d - 1) {
+					solution.push_back(CornerIndex::moves[m]);
+					index = child;
+					descended = true;
+				}
+			}
+			// Only a damaged table, or one of another metric, has a state with no child one closer
+			if (!descended) {
+				solution.clear();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// States at each distance, as found by the last build
+	/// </summary>
+	const std::vector<uint64_t>& levels() const {
+		return _levels;
+	}
+
+	Metric metric() const {
+		return _metric;
+	}
+
+	size_t memoryBytes() const {
+		return WordCount * sizeof(uint64_t);
+	}
+
+	/// <summary>
+	/// Whether two tables hold the same bytes
+	/// </summary>
+	bool sameAs(const DistanceTable& other) const {
+		for (size_t i = 0; i < WordCount; ++i) {
+			if (_words[i].load(std::memory_order_relaxed) != other._words[i].load(std::memory_order_relaxed)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Write the packed entries, word by word, replacing the file only once all are written
+	/// </summary>
+	/// <returns>False if the file could not be written</returns>
+	bool save(const std::string& path) const {
+		AtomicFile file(path);
+		for (const auto& word : _words) {
+			const uint64_t value = word.load(std::memory_order_relaxed);
+			file.stream().write(reinterpret_cast<const char*>(&value), sizeof(value));
+		}
+		return file.commit();
+	}
+
+	/// <summary>
+	/// Read a table written by save, or by ExternalBfs
+	/// </summary>
+	/// <param name="path">Table file</param>
+	/// <param name="metric">Metric the table was built in</param>
+	/// <returns>False, with the reason on cerr, if the file cannot be read, has the wrong size or
+	/// was built in another metric</returns>
+	bool load(const std::string& path, Metric metric) {
+		std::error_code error;
+		const uintmax_t bytes = std::filesystem::file_size(path, error);
+		if (error) {
+			std::cerr << "Cannot read table " << path << ": " << error.message() << std::endl;
+			return false;
+		}
+		if (bytes != WordCount * sizeof(uint64_t)) {
+			std::cerr << "Table " << path << " has " << bytes << " bytes instead of " << WordCount * sizeof(uint64_t) << std::endl;
+			return false;
+		}
+
+		std::ifstream in(path, std::ios::binary);
+		if (!in.is_open()) {
+			std::cerr << "Cannot open table " << path << ": " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		_metric = metric;
+		_levels.clear();
+		for (auto& word : _words) {
+			uint64_t value;
+			if (!in.read(reinterpret_cast<char*>(&value), sizeof(value))) {
+				std::cerr << "Cannot read table " << path << std::endl;
+				return false;
+			}
+			word.store(value, std::memory_order_relaxed);
+		}
+		for (uint32_t index = 0; index < Size; ++index) {
+			const int d = get(index);
+			if (d != Unreached) {
+				_levels.resize(std::max(_levels.size(), (size_t)d + 1));
+				++_levels[d];
+			}
+		}
+		// The file has no header: the states one move from solved tell the metric apart
+		if (!levelsFit(_levels, metric)) {
+			std::cerr << "Table " << path << " was not built in the " << (metric == HALF_TURN ? "half" : "quarter") << " turn metric" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static constexpr size_t ChunkWords = 1024;
+
+	std::vector<std::atomic<uint64_t>> _words;
+	std::vector<uint64_t> _levels;
+	Metric _metric = QUARTER_TURN;
+
+	int get(uint32_t index) const {
+		return (int)(_words[index / EntriesPerWord].load(std::memory_order_relaxed) >> (index % EntriesPerWord * 4)) & 0xF;
+	}
+
+	void set(uint32_t index, int value) {
+		const int shift = index % EntriesPerWord * 4;
+		std::atomic<uint64_t>& word = _words[index / EntriesPerWord];
+		word.store((word.load(std::memory_order_relaxed) & ~(uint64_t(0xF) << shift)) | (uint64_t)value << shift, std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Set an unreached entry to value; false if it was reached already
+	/// </summary>
+	bool claim(uint32_t index, int value) {
+		const int shift = index % EntriesPerWord * 4;
+		std::atomic<uint64_t>& word = _words[index / EntriesPerWord];
+		uint64_t current = word.load(std::memory_order_relaxed);
+		while (((current >> shift) & 0xF) == Unreached) {
+			const uint64_t desired = (current & ~(uint64_t(0xF) << shift)) | (uint64_t)value << shift;
+			if (word.compare_exchange_weak(current, desired, std::memory_order_relaxed)) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Expand the entries at depth in one chunk of words
+	/// </summary>
+	/// <returns>Entries set to depth + 1</returns>
+	uint64_t expandChunk(size_t chunk, int depth) {
+		const CornerIndex& corners = CornerIndex::instance();
+		const int moveCount = CornerIndex::moveCount(_metric);
+		uint64_t found = 0;
+		const size_t end = std::min(WordCount, (chunk + 1) * ChunkWords);
+		for (size_t w = chunk * ChunkWords; w < end; ++w) {
+			const uint64_t word = _words[w].load(std::memory_order_relaxed);
+			for (int e = 0; e < EntriesPerWord; ++e) {
+				const uint32_t index = (uint32_t)(w * EntriesPerWord + e);
+				if (((word >> (e * 4)) & 0xF) != (uint64_t)depth || index >= Size) {
+					continue;
+				}
+				for (int m = 0; m < moveCount; ++m) {
+					found += claim(corners.move(index, m), depth + 1) ? 1 : 0;
+				}
+			}
+		}
+		return found;
+	}
+};
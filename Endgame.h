@@ -0,0 +1,155 @@
+﻿// Endgame.h : Table of the Cube222 states within k moves of solved
+//
+// Most of a depth-first search is spent in its last plies. A breadth first
+// search from the solved state to depth k stores every state it reaches: its
+// distance and a move that leads one step closer, in the slot a minimal perfect
+// hash of its Cube222::encodeFacelets index gives it. The states themselves
+// are not stored. A state outside the table lands on some other state's slot,
+// but walking the stored moves from it cannot reach solved within k moves, so
+// the walk is the membership test. A search that reaches k moves left probes
+// the table: a state in it is finished by the walk, a state not in it is more
+// than k moves away and is cut off. Either way the last k plies are never
+// expanded.
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+
+#include "Cube.h"
+#include "PerfectHash.h"
+
+class EndgameTable : public EndgameProbe {
+public:
+	using Facelets = Cube222::Facelets;
+
+	/// <summary>
+	/// Breadth first search from the solved state with the turns that keep the DBL corner in place
+	/// </summary>
+	/// <param name="depth">Deepest distance stored</param>
+	/// <param name="metric">Quarter turns only, or quarter and half turns</param>
+	/// <param name="threads">Threads that build the hash</param>
+	void build(int depth, Metric metric = QUARTER_TURN, int threads = 1) {
+		static const std::vector<Rotation> quarterTurns = { U, R, F, UI, RI, FI };
+		static const std::vector<Rotation> faceTurns = { U, R, F, UI, RI, FI, U2, R2, F2 };
+		const std::vector<Rotation>& moves = metric == HALF_TURN ? faceTurns : quarterTurns;
+		_depth = depth;
+		_metric = metric;
+
+		// Visited states are one bit each while building, as in Perft
+		std::vector<uint64_t> visited((Cube222::StateCount + 63) / 64);
+		std::vector<uint64_t> states;
+		std::vector<uint16_t> entries;
+		std::vector<Facelets> frontier = { Cube222().getFacelets() };
+		const uint32_t solved = Cube222::encodeFacelets(frontier[0]);
+		visited[solved / 64] |= uint64_t(1) << (solved % 64);
+		_solved = solved;
+		states.push_back(solved);
+		entries.push_back(pack(0, U));
+		for (int d = 1; d <= depth && !frontier.empty(); ++d) {
+			std::vector<Facelets> next;
+			for (const Facelets& state : frontier) {
+				for (Rotation move : moves) {
+					const Facelets child = Cube222::permute(state, Cube222::moveFacelets[move]);
+					const uint32_t index = Cube222::encodeFacelets(child);
+					uint64_t& word = visited[index / 64];
+					const uint64_t bit = uint64_t(1) << (index % 64);
+					if ((word & bit) != 0) {
+						continue;
+					}
+					word |= bit;
+					next.push_back(child);
+					states.push_back(index);
+					entries.push_back(pack(d, inverseRotation(move)));
+				}
+			}
+			frontier.swap(next);
+		}
+
+		// Each entry goes to its state's slot
+		_hash.build(states, 1.0, threads);
+		_entries.assign(states.size(), 0);
+		for (size_t i = 0; i < states.size(); ++i) {
+			_entries[_hash.lookup(states[i])] = entries[i];
+		}
+	}
+
+	bool supports(const Cube& cube) const override {
+		return dynamic_cast<const Cube222*>(&cube) != nullptr;
+	}
+
+	int probe(const Cube& cube, std::vector<Rotation>& finish) const override {
+		return solve(static_cast<const Cube222&>(cube).getFacelets(), finish);
+	}
+
+	int depth() const override {
+		return _depth;
+	}
+
+	Metric metric() const override {
+		return _metric;
+	}
+
+	size_t size() const {
+		return _entries.size();
+	}
+
+	size_t memoryBytes() const {
+		return _entries.size() * sizeof(uint16_t) + _hash.memoryBytes();
+	}
+
+	/// <summary>
+	/// Distance of a state, walking the stored moves down to solved
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme with the DBL corner fixed</param>
+	/// <param name="finish">Optimal moves to solved</param>
+	/// <returns>Distance, -1 if more than depth moves</returns>
+	int solve(Facelets facelets, std::vector<Rotation>& finish) const {
+		finish.clear();
+		uint32_t state = Cube222::encodeFacelets(facelets);
+		int entry = find(state);
+		if (entry < 0) {
+			return -1;
+		}
+
+		// Each step must land on a state one closer, and the last one on solved
+		const int distance = entry >> 8;
+		for (int d = distance; d > 0; --d) {
+			const Rotation move = (Rotation)(entry & 0xFF);
+			finish.push_back(move);
+			facelets = Cube222::permute(facelets, Cube222::moveFacelets[move]);
+			state = Cube222::encodeFacelets(facelets);
+			entry = find(state);
+			if (entry < 0 || (entry >> 8) != d - 1) {
+				finish.clear();
+				return -1;
+			}
+		}
+		if (state != _solved) {
+			finish.clear();
+			return -1;
+		}
+		return distance;
+	}
+
+private:
+	PerfectHash _hash;
+	std::vector<uint16_t> _entries;
+	uint32_t _solved = 0;
+	int _depth = 0;
+	Metric _metric = QUARTER_TURN;
+
+	static uint16_t pack(int depth, Rotation move) {
+		return (uint16_t)((depth << 8) | move);
+	}
+
+	/// <summary>
+	/// Entry in the slot of a state, which is another state's entry if the state is not in the table
+	/// </summary>
+	/// <returns>Entry, -1 for a state the hash places outside the table</returns>
+	int find(uint32_t state) const {
+		const uint64_t slot = _hash.lookup(state);
+		return slot < _entries.size() ? _entries[slot] : -1;
+	}
+};
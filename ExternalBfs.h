@@ -0,0 +1,430 @@
+﻿// ExternalBfs.h : Disk-backed breadth first search for tables larger than memory
+//
+// Same search as DistanceTable::build, with the layers on disk instead of a
+// table in memory. The children of layer d are collected in a buffer; each time
+// it fills, it is sorted, deduplicated and written out as a run. The runs are
+// then merged, and every index already in layer d or d - 1 is dropped on the
+// way (in an undirected move graph a child can only sit in those or be new).
+// What is left is layer d + 1, a sorted file. Half the memory cap goes to the
+// buffer, the other half to one read buffer per open file. When a layer has
+// more runs than those buffers can merge at once, groups of runs are first
+// merged into longer runs, as many passes as it takes. At the end the layers
+// are merged into a table file byte-identical to DistanceTable::save. A layer
+// file only appears once it is complete, so a build that was killed picks up
+// from the layers it left in the directory; a build that fails removes them.
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <queue>
+#include <filesystem>
+
+#include "DistanceTable.h"
+#include "Checkpoint.h"
+
+class ExternalBfs {
+public:
+	static constexpr size_t DefaultReadBufferEntries = 4096;
+
+	/// <param name="directory">Directory for the layer and run files, created if missing</param>
+	/// <param name="memoryCap">Bytes of buffers the search may hold at once</param>
+	/// <param name="readBufferEntries">Indices read or written per file access</param>
+	ExternalBfs(const std::string& directory, size_t memoryCap, size_t readBufferEntries = DefaultReadBufferEntries) :
+		_directory(directory), _memoryCap(memoryCap), _readBufferEntries(readBufferEntries) {
+	}
+
+	/// <summary>
+	/// Smallest memory cap build accepts: two read buffers for every layer a table can have
+	/// </summary>
+	static size_t smallestCap(size_t readBufferEntries = DefaultReadBufferEntries) {
+		return 2 * (DistanceTable::Unreached + 2) * readBufferEntries * sizeof(uint32_t);
+	}
+
+	/// <summary>
+	/// Breadth first search from the solved state, from the deepest complete layer left in the
+	/// directory if any, then the table file
+	/// </summary>
+	/// <param name="metric">Quarter turns only, or quarter and half turns</param>
+	/// <param name="tablePath">Output, in the DistanceTable::save format</param>
+	/// <param name="maxDepth">Deepest layer searched, -1 for all; states further away stay unreached</param>
+	/// <returns>False on a file error or a cap too small for the buffers</returns>
+	bool build(Metric metric, const std::string& tablePath, int maxDepth = -1) {
+		std::error_code error;
+		std::filesystem::create_directories(_directory, error);
+		_bufferCapacity = _memoryCap / 2 / sizeof(uint32_t);
+		_maxReaders = _memoryCap / 2 / readBufferBytes();
+		if (_memoryCap < smallestCap(_readBufferEntries)) {
+			std::cerr << "Memory cap below " << smallestCap(_readBufferEntries) << " bytes" << std::endl;
+			return false;
+		}
+		// Leaves the directory without partial layers or runs, for a clean start next time
+		auto fail = [&]() {
+			removeFiles();
+			return false;
+		};
+		_peakBytes = 0;
+		_mergePasses = 0;
+
+		_levels.clear();
+		for (int depth = 0; std::filesystem::exists(layerPath(depth)); ++depth) {
+			_levels.push_back(std::filesystem::file_size(layerPath(depth), error) / sizeof(uint32_t));
+		}
+		if (DistanceTable::levelsFit(_levels, metric)) {
+			std::cout << "Resuming the external search at layer " << _levels.size() - 1 << ".\n";
+		}
+		else {
+			Writer first(layerPath(0), _readBufferEntries);
+			first.write(0);
+			if (!first.close()) {
+				return fail();
+			}
+			_levels = { 1 };
+		}
+		if (maxDepth >= 0 && (int)_levels.size() > maxDepth + 1) {
+			_levels.resize(maxDepth + 1);
+		}
+		for (int depth = (int)_levels.size() - 1; _levels.back() > 0 && (maxDepth < 0 || depth < maxDepth); ++depth) {
+			const int runs = reduceRuns(writeRuns(metric, depth));
+			if (runs < 0) {
+				return fail();
+			}
+			const int64_t found = mergeRuns(runs, depth);
+			if (found < 0) {
+				return fail();
+			}
+			_levels.push_back((uint64_t)found);
+			if (_levels.back() > 0 && depth + 1 >= DistanceTable::Unreached) {
+				std::cerr << "Depth beyond the 4-bit entries" << std::endl;
+				return fail();
+			}
+		}
+		if (_levels.back() == 0) {
+			_levels.pop_back();
+			std::filesystem::remove(layerPath((int)_levels.size()), error);
+		}
+
+		const bool written = writeTable(tablePath);
+		removeFiles();
+		return written;
+	}
+
+	/// <summary>
+	/// States at each distance
+	/// </summary>
+	const std::vector<uint64_t>& levels() const {
+		return _levels;
+	}
+
+	/// <summary>
+	/// Most buffer memory held at once
+	/// </summary>
+	size_t peakBytes() const {
+		return _peakBytes;
+	}
+
+	/// <summary>
+	/// Passes that merged groups of runs into longer runs, over all layers
+	/// </summary>
+	int mergePasses() const {
+		return _mergePasses;
+	}
+
+private:
+	std::string _directory;
+	size_t _memoryCap;
+	size_t _readBufferEntries;
+	size_t _bufferCapacity = 0;
+	size_t _maxReaders = 0;
+	size_t _peakBytes = 0;
+	int _mergePasses = 0;
+	std::vector<uint64_t> _levels;
+
+	size_t readBufferBytes() const {
+		return _readBufferEntries * sizeof(uint32_t);
+	}
+
+	/// <summary>
+	/// Sequential writer of a sorted index file, which appears under its name once closed
+	/// </summary>
+	class Writer {
+	public:
+		Writer(const std::string& path, size_t bufferEntries) : _file(path), _bufferEntries(bufferEntries) {
+		}
+
+		void write(uint32_t value) {
+			_buffer.push_back(value);
+			if (_buffer.size() == _bufferEntries) {
+				flush();
+			}
+		}
+
+		/// <summary>
+		/// Write what is buffered and move the file into place
+		/// </summary>
+		/// <returns>False on a file error</returns>
+		bool close() {
+			flush();
+			return _file.commit();
+		}
+
+	private:
+		AtomicFile _file;
+		size_t _bufferEntries;
+		std::vector<uint32_t> _buffer;
+
+		void flush() {
+			_file.stream().write(reinterpret_cast<const char*>(_buffer.data()), _buffer.size() * sizeof(uint32_t));
+			_buffer.clear();
+		}
+	};
+
+	/// <summary>
+	/// Sequential reader of a sorted index file, positioned on its smallest unread value
+	/// </summary>
+	class Reader {
+	public:
+		Reader(const std::string& path, size_t bufferEntries) : _in(path, std::ios::binary), _buffer(bufferEntries) {
+			advance();
+		}
+
+		bool valid() const {
+			return _valid;
+		}
+
+		uint32_t value() const {
+			return _value;
+		}
+
+		void advance() {
+			if (_next == _count) {
+				_in.read(reinterpret_cast<char*>(_buffer.data()), _buffer.size() * sizeof(uint32_t));
+				_count = (size_t)_in.gcount() / sizeof(uint32_t);
+				_next = 0;
+			}
+			_valid = _next < _count;
+			if (_valid) {
+				_value = _buffer[_next++];
+			}
+		}
+
+		/// <summary>
+		/// Skip to the first value not below target
+		/// </summary>
+		void seek(uint32_t target) {
+			while (_valid && _value < target) {
+				advance();
+			}
+		}
+
+	private:
+		std::ifstream _in;
+		std::vector<uint32_t> _buffer;
+		size_t _count = 0;
+		size_t _next = 0;
+		uint32_t _value = 0;
+		bool _valid = false;
+	};
+
+	std::string layerPath(int depth) const {
+		return (std::filesystem::path(_directory) / ("layer" + std::to_string(depth) + ".bin")).string();
+	}
+
+	std::string runPath(int run) const {
+		return (std::filesystem::path(_directory) / ("run" + std::to_string(run) + ".bin")).string();
+	}
+
+	/// <summary>
+	/// Remove every layer and run file from the directory
+	/// </summary>
+	void removeFiles() const {
+		std::error_code error;
+		std::vector<std::filesystem::path> files;
+		for (const auto& entry : std::filesystem::directory_iterator(_directory, error)) {
+			const std::string name = entry.path().filename().string();
+			if ((name.rfind("layer", 0) == 0 || name.rfind("run", 0) == 0) && entry.path().extension() == ".bin") {
+				files.push_back(entry.path());
+			}
+		}
+		for (const auto& file : files) {
+			std::filesystem::remove(file, error);
+		}
+	}
+
+	/// <summary>
+	/// Merge sorted inputs, each value once however many inputs hold it
+	/// </summary>
+	/// <param name="inputs">Readers, positioned on their first value</param>
+	/// <param name="emit">Called with each value in increasing order</param>
+	template <typename Emit>
+	static void mergeSorted(std::vector<std::unique_ptr<Reader>>& inputs, Emit emit) {
+		// Heads of the inputs, smallest first
+		using Head = std::pair<uint32_t, Reader*>;
+		std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+		for (auto& input : inputs) {
+			if (input->valid()) {
+				heads.push({ input->value(), input.get() });
+			}
+		}
+		while (!heads.empty()) {
+			const uint32_t index = heads.top().first;
+			while (!heads.empty() && heads.top().first == index) {
+				Reader* input = heads.top().second;
+				heads.pop();
+				input->advance();
+				if (input->valid()) {
+					heads.push({ input->value(), input });
+				}
+			}
+			emit(index);
+		}
+	}
+
+	void usesBytes(size_t bytes) {
+		_peakBytes = std::max(_peakBytes, bytes);
+	}
+
+	/// <summary>
+	/// Children of a layer in sorted, duplicate free runs of at most one buffer each
+	/// </summary>
+	/// <returns>Number of runs, -1 on a file error</returns>
+	int writeRuns(Metric metric, int depth) {
+		const CornerIndex& corners = CornerIndex::instance();
+		std::vector<uint32_t> buffer;
+		buffer.reserve(_bufferCapacity);
+		int runs = 0;
+		bool good = true;
+		auto flushRun = [&]() {
+			std::sort(buffer.begin(), buffer.end());
+			buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+			Writer run(runPath(runs++), _readBufferEntries);
+			for (uint32_t index : buffer) {
+				run.write(index);
+			}
+			good = run.close() && good;
+			buffer.clear();
+		};
+
+		Reader layer(layerPath(depth), _readBufferEntries);
+		usesBytes(buffer.capacity() * sizeof(uint32_t) + 2 * readBufferBytes());
+		for (; layer.valid(); layer.advance()) {
+			for (int m = 0; m < CornerIndex::moveCount(metric); ++m) {
+				buffer.push_back(corners.move(layer.value(), m));
+				if (buffer.size() == _bufferCapacity) {
+					flushRun();
+				}
+			}
+		}
+		if (!buffer.empty()) {
+			flushRun();
+		}
+		return good ? runs : -1;
+	}
+
+	/// <summary>
+	/// Merge groups of runs into longer runs until the final merge can read them all next to
+	/// the two layers it filters against. Group g of a pass becomes run g: each run is only
+	/// overwritten once its own group is merged.
+	/// </summary>
+	/// <param name="runs">Number of runs, -1 passed on</param>
+	/// <returns>Number of runs left, -1 on a file error</returns>
+	int reduceRuns(int runs) {
+		const int fanIn = (int)_maxReaders - 2;
+		while (runs > fanIn) {
+			int merged = 0;
+			for (int first = 0; first < runs; first += fanIn) {
+				std::vector<std::unique_ptr<Reader>> inputs;
+				for (int r = first; r < std::min(runs, first + fanIn); ++r) {
+					inputs.push_back(std::make_unique<Reader>(runPath(r), _readBufferEntries));
+				}
+				usesBytes((inputs.size() + 1) * readBufferBytes());
+				Writer out(runPath(merged++), _readBufferEntries);
+				mergeSorted(inputs, [&](uint32_t index) { out.write(index); });
+				// The inputs are closed before the output is renamed over the first of them
+				inputs.clear();
+				if (!out.close()) {
+					return -1;
+				}
+			}
+			std::error_code error;
+			for (int r = merged; r < runs; ++r) {
+				std::filesystem::remove(runPath(r), error);
+			}
+			runs = merged;
+			++_mergePasses;
+		}
+		return runs;
+	}
+
+	/// <summary>
+	/// Merge the runs into the next layer, leaving out what layers depth and depth - 1 hold
+	/// </summary>
+	/// <returns>Size of the next layer, -1 on a file error</returns>
+	int64_t mergeRuns(int runs, int depth) {
+		std::vector<std::unique_ptr<Reader>> inputs;
+		for (int r = 0; r < runs; ++r) {
+			inputs.push_back(std::make_unique<Reader>(runPath(r), _readBufferEntries));
+		}
+		Reader current(layerPath(depth), _readBufferEntries);
+		std::unique_ptr<Reader> previous = depth > 0 ? std::make_unique<Reader>(layerPath(depth - 1), _readBufferEntries) : nullptr;
+		usesBytes((runs + 3) * readBufferBytes());
+
+		int64_t found = 0;
+		bool good;
+		{
+			Writer next(layerPath(depth + 1), _readBufferEntries);
+			mergeSorted(inputs, [&](uint32_t index) {
+				current.seek(index);
+				if (previous != nullptr) {
+					previous->seek(index);
+				}
+				if ((current.valid() && current.value() == index) || (previous != nullptr && previous->valid() && previous->value() == index)) {
+					return;
+				}
+				next.write(index);
+				++found;
+			});
+			good = next.close();
+		}
+
+		inputs.clear();
+		std::error_code error;
+		for (int r = 0; r < runs; ++r) {
+			std::filesystem::remove(runPath(r), error);
+		}
+		return good ? found : -1;
+	}
+
+	/// <summary>
+	/// Merge the layers into packed 4-bit entries, in index order
+	/// </summary>
+	bool writeTable(const std::string& path) const {
+		std::vector<std::unique_ptr<Reader>> layers;
+		for (int depth = 0; depth < (int)_levels.size(); ++depth) {
+			layers.push_back(std::make_unique<Reader>(layerPath(depth), _readBufferEntries));
+		}
+
+		AtomicFile file(path);
+		std::ofstream& out = file.stream();
+		for (size_t w = 0; w < DistanceTable::WordCount; ++w) {
+			uint64_t word = ~uint64_t(0);
+			for (int e = 0; e < DistanceTable::EntriesPerWord; ++e) {
+				const uint32_t index = (uint32_t)(w * DistanceTable::EntriesPerWord + e);
+				for (int depth = 0; depth < (int)layers.size(); ++depth) {
+					if (layers[depth]->valid() && layers[depth]->value() == index) {
+						word &= ~(uint64_t(0xF) << (e * 4));
+						word |= (uint64_t)depth << (e * 4);
+						layers[depth]->advance();
+						break;
+					}
+				}
+			}
+			out.write(reinterpret_cast<const char*>(&word), sizeof(word));
+		}
+		return file.commit();
+	}
+};
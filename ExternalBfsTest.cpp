@@ -0,0 +1,111 @@
+﻿// ExternalBfsTest.cpp : The external-memory table build against the in-memory one
+//
+// By default the search runs with tiny read buffers under the smallest cap they
+// allow, and stops a few layers down: the deepest of those layers already needs
+// more runs than the cap can merge at once, so the merge passes are exercised,
+// and every distance in the table must match the in-memory one up to that depth.
+// Run with "full" (ctest does with -DRUBIKS_SLOW_TESTS=ON), the whole table is
+// built under the default buffers and must match DistanceTable::save byte for
+// byte. In both metrics, no layer or run file may be left behind, whether the
+// build succeeds or not.
+
+#include "DistanceTable.h"
+#include "ExternalBfs.h"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <filesystem>
+
+namespace {
+
+	// Small enough that thousands of runs make up the deepest layer searched
+	constexpr size_t TinyReadBufferEntries = 64;
+
+	std::string readFile(const std::filesystem::path& path) {
+		std::ifstream in(path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	/// <summary>
+	/// Layer and run files left in the build directory
+	/// </summary>
+	int leftovers(const std::filesystem::path& directory) {
+		int count = 0;
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+			if (entry.path().extension() == ".bin") {
+				++count;
+			}
+		}
+		return count;
+	}
+
+	bool check(bool condition, const std::string& message) {
+		if (!condition) {
+			std::cerr << "FAILED: " << message << std::endl;
+		}
+		return condition;
+	}
+}
+
+int main(int argc, char* argv[]) {
+	const bool full = argc > 1 && std::string(argv[1]) == "full";
+	const size_t readBufferEntries = full ? ExternalBfs::DefaultReadBufferEntries : TinyReadBufferEntries;
+	const size_t smallestCap = ExternalBfs::smallestCap(readBufferEntries);
+	// Apart from the other run, so that ctest -j can run both
+	const std::filesystem::path root = std::filesystem::temp_directory_path() / (full ? "RubiksSolver_external_test_full" : "RubiksSolver_external_test");
+	const std::filesystem::path directory = root / "layers";
+	std::filesystem::remove_all(root);
+	std::filesystem::create_directories(root);
+	bool good = true;
+
+	for (Metric metric : { QUARTER_TURN, HALF_TURN }) {
+		const std::string name = metric == HALF_TURN ? "htm" : "qtm";
+		const std::filesystem::path expectedPath = root / (name + "_memory.tbl");
+		const std::filesystem::path externalPath = root / (name + "_external.tbl");
+
+		// Two merge passes into the deepest layer at these depths
+		const int maxDepth = full ? -1 : (metric == HALF_TURN ? 7 : 8);
+
+		auto table = std::make_unique<DistanceTable>();
+		table->build(metric);
+		good = check(table->save(expectedPath.string()), name + ": in-memory table not written") && good;
+
+		ExternalBfs search(directory.string(), smallestCap, readBufferEntries);
+		good = check(search.build(metric, externalPath.string(), maxDepth), name + ": external build failed") && good;
+		good = check(leftovers(directory) == 0, name + ": layer or run files left after the build") && good;
+		if (full) {
+			good = check(search.levels() == table->levels(), name + ": level counts differ") && good;
+			good = check(readFile(externalPath) == readFile(expectedPath), name + ": table files differ") && good;
+			continue;
+		}
+
+		const std::vector<uint64_t> expectedLevels(table->levels().begin(), table->levels().begin() + maxDepth + 1);
+		good = check(search.levels() == expectedLevels, name + ": level counts differ") && good;
+		good = check(search.mergePasses() >= 2, name + ": fewer than two merge passes") && good;
+		auto external = std::make_unique<DistanceTable>();
+		if (check(external->load(externalPath.string(), metric), name + ": external table not loaded")) {
+			uint32_t differing = 0;
+			for (uint32_t index = 0; index < DistanceTable::Size; ++index) {
+				const int expected = table->distance(index);
+				differing += external->distance(index) != (expected <= maxDepth ? expected : -1);
+			}
+			good = check(differing == 0, name + ": " + std::to_string(differing) + " distances differ") && good;
+		}
+		else {
+			good = false;
+		}
+	}
+
+	// A table file that cannot be written fails the build, which then cleans up after itself
+	ExternalBfs failing(directory.string(), smallestCap, readBufferEntries);
+	good = check(!failing.build(QUARTER_TURN, (root / "missing" / "table.bin").string(), 3), "build into a missing directory succeeded") && good;
+	good = check(leftovers(directory) == 0, "layer or run files left after a failed build") && good;
+	good = check(!ExternalBfs(directory.string(), smallestCap - 1, readBufferEntries).build(QUARTER_TURN, (root / "small.tbl").string()), "build below the smallest cap succeeded") && good;
+
+	std::filesystem::remove_all(root);
+	std::cout << (good ? "ExternalBfs: all checks passed" : "ExternalBfs: checks failed") << std::endl;
+	return good ? 0 : 1;
+}
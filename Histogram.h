@@ -0,0 +1,137 @@
+﻿// Histogram.h : Log-bucketed latency histogram with percentiles
+//
+// Same layout as an HdrHistogram with two significant digits: values below 256
+// get a bucket each, and every power of two above that is split into 128
+// linear sub-buckets, so a recorded value is off by less than 1% wherever it
+// lands and the whole uint64 range fits in 7424 counters. Each thread records
+// into its own histogram; the counters are relaxed atomics written only by the
+// owner, so a reader can merge the histograms while they are being filled.
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+class LatencyHistogram {
+public:
+	static constexpr int SubBucketBits = 7;
+	static constexpr uint64_t SubBucketCount = uint64_t(1) << SubBucketBits;
+	static constexpr size_t BucketCount = 2 * SubBucketCount + (64 - SubBucketBits - 1) * SubBucketCount;
+
+	LatencyHistogram() : _counts(BucketCount) {
+	}
+
+	LatencyHistogram(const LatencyHistogram& other) : _counts(BucketCount) {
+		merge(other);
+	}
+
+	LatencyHistogram& operator=(const LatencyHistogram& other) {
+		if (this != &other) {
+			reset();
+			merge(other);
+		}
+		return *this;
+	}
+
+	/// <summary>
+	/// Count one value, by the owning thread
+	/// </summary>
+	void record(uint64_t value) {
+		add(_counts[bucket(value)], 1);
+		add(_total, 1);
+		if (value > _max.load(std::memory_order_relaxed)) {
+			_max.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	/// <summary>
+	/// Add the counts of another histogram
+	/// </summary>
+	void merge(const LatencyHistogram& other) {
+		for (size_t i = 0; i < BucketCount; ++i) {
+			const uint64_t count = other._counts[i].load(std::memory_order_relaxed);
+			if (count > 0) {
+				add(_counts[i], count);
+			}
+		}
+		add(_total, other._total.load(std::memory_order_relaxed));
+		_max.store(std::max(max(), other.max()), std::memory_order_relaxed);
+	}
+
+	void reset() {
+		for (auto& count : _counts) {
+			count.store(0, std::memory_order_relaxed);
+		}
+		_total.store(0, std::memory_order_relaxed);
+		_max.store(0, std::memory_order_relaxed);
+	}
+
+	uint64_t count() const {
+		return _total.load(std::memory_order_relaxed);
+	}
+
+	uint64_t max() const {
+		return _max.load(std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Smallest value that percentile percent of the recorded values do not exceed, rounded up
+	/// to the top of its bucket and capped at the maximum
+	/// </summary>
+	/// <param name="percentile">0 to 100, e.g. 99.9</param>
+	/// <returns>Value, 0 when empty</returns>
+	uint64_t percentile(double percentile) const {
+		const uint64_t total = count();
+		if (total == 0) {
+			return 0;
+		}
+		const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(percentile / 100 * total + 0.5));
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BucketCount; ++i) {
+			seen += _counts[i].load(std::memory_order_relaxed);
+			if (seen >= rank) {
+				return std::min(highestEquivalent(i), max());
+			}
+		}
+		return max();
+	}
+
+	/// <summary>
+	/// Bucket of a value: values below 2 * SubBucketCount map to themselves, above that the
+	/// top SubBucketBits + 1 bits pick the bucket
+	/// </summary>
+	static size_t bucket(uint64_t value) {
+		const int shift = std::max(0, (int)std::bit_width(value) - SubBucketBits - 1);
+		if (shift == 0) {
+			return (size_t)value;
+		}
+		return (size_t)(2 * SubBucketCount + (shift - 1) * SubBucketCount + ((value >> shift) - SubBucketCount));
+	}
+
+	/// <summary>
+	/// Largest value that lands in a bucket
+	/// </summary>
+	static uint64_t highestEquivalent(size_t index) {
+		if (index < 2 * SubBucketCount) {
+			return index;
+		}
+		const int shift = (int)((index - 2 * SubBucketCount) / SubBucketCount) + 1;
+		const uint64_t top = SubBucketCount + (index - 2 * SubBucketCount) % SubBucketCount;
+		return ((top + 1) << shift) - 1;
+	}
+
+private:
+	std::vector<std::atomic<uint64_t>> _counts;
+	std::atomic<uint64_t> _total = 0;
+	std::atomic<uint64_t> _max = 0;
+
+	/// <summary>
+	/// Single writer increment: a relaxed load and store, no read-modify-write
+	/// </summary>
+	static void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+		counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+};
@@ -0,0 +1,157 @@
+﻿// Lehmer.h : Ranking and unranking of permutations and orientations.
+//
+// Every table indexed by a cube state needs a perfect index of the corner
+// (and, for bigger cubes, edge) permutation and orientation. The naive
+// Lehmer code counts the smaller elements to the right of each position,
+// which is O(n^2). Here the counts live in sixteen 4-bit lanes of one 64-bit
+// word, so ranking and unranking are O(n) for n up to 16 without needing a
+// hardware popcount.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+class Lehmer {
+public:
+	/// <summary>
+	/// Largest permutation size supported (12 edges of a 3x3x3 cube fit with room to spare)
+	/// </summary>
+	static constexpr int MaxSize = 16;
+
+	/// <summary>
+	/// n! for n in [0, MaxSize]
+	/// </summary>
+	/// <param name="n">Size</param>
+	/// <returns>n factorial</returns>
+	static constexpr uint64_t factorial(int n) {
+		uint64_t f = 1;
+		for (int i = 2; i <= n; ++i) {
+			f *= i;
+		}
+		return f;
+	}
+
+	/// <summary>
+	/// base^n, the number of orientation states of n pieces
+	/// </summary>
+	/// <param name="base">Orientation count of one piece (3 for corners, 2 for edges)</param>
+	/// <param name="n">Piece count</param>
+	/// <returns>base to the power of n</returns>
+	static constexpr uint64_t power(int base, int n) {
+		uint64_t p = 1;
+		for (int i = 0; i < n; ++i) {
+			p *= base;
+		}
+		return p;
+	}
+
+	/// <summary>
+	/// Rank a permutation of {0..N-1} into [0, N!)
+	/// </summary>
+	/// <param name="perm">Permutation, perm[i] is the element at position i</param>
+	/// <returns>Lexicographic rank of the permutation</returns>
+	template <size_t N>
+	static uint64_t rankPermutation(const std::array<uint8_t, N>& perm) {
+		static_assert(N <= MaxSize, "Permutation too large for Lehmer ranking");
+		// Lane k holds how many of the elements seen so far are smaller than k
+		uint64_t smallerSeen = 0;
+		uint64_t rank = 0;
+		for (size_t i = 0; i < N; ++i) {
+			const uint32_t v = perm[i];
+			const uint32_t digit = v - (uint32_t)((smallerSeen >> (4 * v)) & 0xF);
+			rank = rank * (N - i) + digit;
+			smallerSeen += LaneOnes << (4 * v) << 4;
+		}
+		return rank;
+	}
+
+	/// <summary>
+	/// Inverse of rankPermutation
+	/// </summary>
+	/// <param name="rank">Rank in [0, N!)</param>
+	/// <param name="perm">Output permutation</param>
+	template <size_t N>
+	static void unrankPermutation(uint64_t rank, std::array<uint8_t, N>& perm) {
+		static_assert(N <= MaxSize, "Permutation too large for Lehmer ranking");
+		// Mixed radix digits; 12! still fits 32 bits, which keeps the divisions cheap
+		using Word = std::conditional_t<N <= 12, uint32_t, uint64_t>;
+		Word r = (Word)rank;
+		std::array<uint8_t, N> digits{};
+		for (size_t i = N; i-- > 0;) {
+			const Word radix = (Word)(N - i);
+			digits[i] = (uint8_t)(r % radix);
+			r /= radix;
+		}
+
+		// Unused elements in increasing order, one per 4-bit lane
+		uint64_t unused = IdentityLanes;
+		for (size_t i = 0; i < N; ++i) {
+			const uint32_t shift = 4 * digits[i];
+			const uint64_t below = (uint64_t(1) << shift) - 1;
+			perm[i] = (uint8_t)((unused >> shift) & 0xF);
+			unused = (unused & below) | ((unused >> 4) & ~below);
+		}
+	}
+
+	/// <summary>
+	/// Rank the orientations of N pieces. The last piece is implied by the others
+	/// (the orientation sum is 0 mod base), so the result lies in [0, base^(N-1)).
+	/// </summary>
+	/// <param name="ori">Orientation of each piece, each in [0, base)</param>
+	/// <param name="base">Orientation count of one piece</param>
+	/// <returns>Orientation rank</returns>
+	template <size_t N>
+	static uint32_t rankOrientation(const std::array<uint8_t, N>& ori, int base) {
+		uint32_t rank = 0;
+		for (size_t i = 0; i + 1 < N; ++i) {
+			rank = rank * base + ori[i];
+		}
+		return rank;
+	}
+
+	/// <summary>
+	/// Inverse of rankOrientation, fills in the implied last piece
+	/// </summary>
+	/// <param name="rank">Rank in [0, base^(N-1))</param>
+	/// <param name="base">Orientation count of one piece</param>
+	/// <param name="ori">Output orientations</param>
+	template <size_t N>
+	static void unrankOrientation(uint32_t rank, int base, std::array<uint8_t, N>& ori) {
+		int sum = 0;
+		for (size_t i = N - 1; i-- > 0;) {
+			ori[i] = (uint8_t)(rank % base);
+			sum += ori[i];
+			rank /= base;
+		}
+		ori[N - 1] = (uint8_t)((base - sum % base) % base);
+	}
+
+	/// <summary>
+	/// Parity of a permutation, from its cycle decomposition
+	/// </summary>
+	/// <param name="perm">Permutation</param>
+	/// <returns>0 for even, 1 for odd</returns>
+	template <size_t N>
+	static int permutationParity(const std::array<uint8_t, N>& perm) {
+		uint32_t visited = 0;
+		int parity = 0;
+		for (size_t i = 0; i < N; ++i) {
+			if (visited & (1u << i)) {
+				continue;
+			}
+			int length = 0;
+			for (size_t j = i; !(visited & (1u << j)); j = perm[j]) {
+				visited |= 1u << j;
+				++length;
+			}
+			parity ^= (length + 1) & 1;
+		}
+		return parity;
+	}
+
+private:
+	static constexpr uint64_t LaneOnes = 0x1111111111111111ull;
+	static constexpr uint64_t IdentityLanes = 0xFEDCBA9876543210ull;
+};
@@ -0,0 +1,194 @@
+﻿// Macro.h : Move sequences compiled into a single facelet permutation
+//
+// An algorithm such as "R U RI UI" is applied again and again by a method that
+// works through fixed sequences, and a scramble is replayed whole. A MoveMacro
+// composes the sequence once (Cube222::composeMoves) and then applies it as one
+// permutation, so 20 moves cost what one does. Built with SSSE3 or AVX2 (cmake
+// -DRUBIKS_AVX2=ON) the permutation is also turned into byte shuffle controls:
+// the 24 stickers are read as two overlapping 16-byte halves, and each half of
+// the result is two pshufb, one per source half, or-ed together, so applying a
+// macro is four shuffles. MacroCache keeps the macros of the sequences seen most
+// recently, keyed by the moves, for callers that get the same sequences as text
+// or vectors again and again.
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <list>
+#include <string>
+#include <sstream>
+#include <mutex>
+#include <unordered_map>
+#include <cstdint>
+
+#ifdef __SSSE3__
+#include <immintrin.h>
+#endif
+
+#include "Cube.h"
+
+class MoveMacro {
+public:
+	using Facelets = Cube222::Facelets;
+
+	/// <summary>
+	/// The empty sequence
+	/// </summary>
+	MoveMacro() : MoveMacro(Cube222::composeMoves({}), 0) {
+	}
+
+	MoveMacro(const std::vector<Rotation>& moves) : MoveMacro(Cube222::composeMoves(moves), moves.size()) {
+	}
+
+	/// <param name="perm">Permutation in the moveFacelets form</param>
+	/// <param name="length">Number of moves it stands for</param>
+	MoveMacro(const Facelets& perm, size_t length) : _perm(perm), _length(length) {
+#ifdef __SSSE3__
+		// Output half h covers stickers 8h..8h+15; a control byte with the top bit set gives 0
+		for (int h = 0; h < 2; ++h) {
+			for (int j = 0; j < 16; ++j) {
+				const uint8_t from = perm[h * 8 + j];
+				_low[h][j] = from < 16 ? from : 0x80;
+				_high[h][j] = from < 16 ? 0x80 : (uint8_t)(from - 8);
+			}
+		}
+#endif
+	}
+
+	/// <summary>
+	/// State after the moves
+	/// </summary>
+	Facelets apply(const Facelets& facelets) const {
+#ifdef __SSSE3__
+		Facelets result;
+		const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(facelets.data()));
+		const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(facelets.data() + 8));
+		// The second store overlaps the first on stickers 8..15 with the same values
+		for (int h = 0; h < 2; ++h) {
+			const __m128i half = _mm_or_si128(_mm_shuffle_epi8(low, load(_low[h])), _mm_shuffle_epi8(high, load(_high[h])));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(result.data() + h * 8), half);
+		}
+		return result;
+#else
+		return Cube222::permute(facelets, _perm);
+#endif
+	}
+
+	/// <summary>
+	/// Apply the moves to a cube's stickers. The moves are not logged: the cube's solution
+	/// stays the moves applied one by one.
+	/// </summary>
+	void apply(Cube222& cube) const {
+		cube.setFacelets(apply(cube.getFacelets()));
+	}
+
+	/// <summary>
+	/// This sequence followed by another
+	/// </summary>
+	MoveMacro then(const MoveMacro& next) const {
+		return MoveMacro(Cube222::permute(_perm, next._perm), _length + next._length);
+	}
+
+	/// <summary>
+	/// The sequence that undoes this one
+	/// </summary>
+	MoveMacro inverse() const {
+		Facelets inverse;
+		for (int i = 0; i < Cube222::FaceletCount; ++i) {
+			inverse[_perm[i]] = (uint8_t)i;
+		}
+		return MoveMacro(inverse, _length);
+	}
+
+	/// <summary>
+	/// Permutation in the moveFacelets form
+	/// </summary>
+	const Facelets& permutation() const {
+		return _perm;
+	}
+
+	size_t length() const {
+		return _length;
+	}
+
+private:
+	Facelets _perm;
+	size_t _length;
+#ifdef __SSSE3__
+	alignas(16) uint8_t _low[2][16];
+	alignas(16) uint8_t _high[2][16];
+
+	static __m128i load(const uint8_t* control) {
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(control));
+	}
+#endif
+};
+
+class MacroCache {
+public:
+	MacroCache(size_t capacity = 1024) : _capacity(capacity) {
+	}
+
+	/// <summary>
+	/// Macro of a move sequence, compiled on the first request and kept while it is among the
+	/// capacity sequences used most recently
+	/// </summary>
+	MoveMacro compile(const std::vector<Rotation>& moves) {
+		const std::string key(moves.begin(), moves.end());
+		std::lock_guard<std::mutex> lock(_mutex);
+		auto it = _index.find(key);
+		if (it != _index.end()) {
+			++_hits;
+			_entries.splice(_entries.begin(), _entries, it->second);
+			return it->second->macro;
+		}
+		++_misses;
+		_entries.push_front({ key, MoveMacro(moves) });
+		_index[key] = _entries.begin();
+		if (_entries.size() > _capacity) {
+			_index.erase(_entries.back().key);
+			_entries.pop_back();
+		}
+		return _entries.front().macro;
+	}
+
+	/// <summary>
+	/// Macro of a move sequence written as text, e.g. "R U RI UI"
+	/// </summary>
+	/// <returns>False if a move name is unknown</returns>
+	bool compile(const std::string& text, MoveMacro& macro) {
+		std::istringstream in(text);
+		std::vector<Rotation> moves;
+		if (!Cube::parseMoves(in, moves)) {
+			return false;
+		}
+		macro = compile(moves);
+		return true;
+	}
+
+	uint64_t hits() const {
+		return _hits;
+	}
+
+	uint64_t misses() const {
+		return _misses;
+	}
+
+	size_t size() const {
+		return _entries.size();
+	}
+
+private:
+	struct Entry {
+		std::string key;                    // One byte per move
+		MoveMacro macro;
+	};
+
+	size_t _capacity;
+	std::list<Entry> _entries;              // Most recently used first
+	std::unordered_map<std::string, std::list<Entry>::iterator> _index;
+	std::mutex _mutex;
+	uint64_t _hits = 0;
+	uint64_t _misses = 0;
+};
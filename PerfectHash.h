@@ -0,0 +1,177 @@
+﻿// PerfectHash.h : Minimal perfect hash over a fixed set of 64-bit state keys
+//
+// A set of states that no ranking function covers (the states within k moves,
+// a cache's contents) can still be given dense slots without storing the keys.
+// BBHash layout: level 0 is a bit array of gamma * N bits; every key hashes to
+// one bit, and a key alone on its bit keeps it. The keys that collided move on
+// to level 1, sized for them alone, and so on. The slot of a key is the rank of
+// its bit among all the kept bits, from a popcount sample every 512 bits. With
+// gamma 1 that is about 3 bits a key. The few keys still colliding after
+// MaxLevels levels go to a small map. A level is built on several threads with
+// fetch_or on the bit words; where a key lands does not depend on the order the
+// keys are seen, so the result does not depend on the thread count either.
+// Keys outside the set map to an arbitrary slot, or to size(): callers that can
+// be asked about other keys check membership themselves.
+
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <unordered_map>
+#include <bit>
+#include <cstdint>
+
+class PerfectHash {
+public:
+	static constexpr int MaxLevels = 32;
+
+	/// <summary>
+	/// Build the hash of a set of keys
+	/// </summary>
+	/// <param name="keys">Distinct keys</param>
+	/// <param name="gamma">Bits per remaining key at each level: 1 is the smallest, more builds and looks up faster</param>
+	/// <param name="threads">Worker threads, 1 builds on the calling thread</param>
+	void build(const std::vector<uint64_t>& keys, double gamma = 1.0, int threads = 1) {
+		_size = keys.size();
+		_bits.clear();
+		_levels.clear();
+		_fallback.clear();
+
+		std::vector<uint64_t> remaining = keys;
+		for (int level = 0; level < MaxLevels && !remaining.empty(); ++level) {
+			const uint64_t words = std::max<uint64_t>(1, ((uint64_t)(gamma * remaining.size()) + 63) / 64);
+			_levels.push_back({ (uint64_t)_bits.size(), words * 64 });
+			remaining = buildLevel(remaining, level, words, threads);
+		}
+
+		// Slots of the level keys come first, then the keys left over
+		_ranks.resize(_bits.size() / RankWords + 1);
+		uint64_t rank = 0;
+		for (size_t w = 0; w < _bits.size(); ++w) {
+			if (w % RankWords == 0) {
+				_ranks[w / RankWords] = rank;
+			}
+			rank += std::popcount(_bits[w]);
+		}
+		for (uint64_t key : remaining) {
+			_fallback.emplace(key, rank++);
+		}
+	}
+
+	/// <summary>
+	/// Slot of a key
+	/// </summary>
+	/// <returns>In [0, size()) for a key of the set, arbitrary or size() for any other key</returns>
+	uint64_t lookup(uint64_t key) const {
+		for (size_t level = 0; level < _levels.size(); ++level) {
+			const uint64_t position = _levels[level].offset * 64 + hash(key, (int)level) % _levels[level].bits;
+			if ((_bits[position / 64] >> (position % 64)) & 1) {
+				return rank(position);
+			}
+		}
+		auto it = _fallback.find(key);
+		return it == _fallback.end() ? _size : it->second;
+	}
+
+	size_t size() const {
+		return _size;
+	}
+
+	size_t memoryBytes() const {
+		return _bits.size() * sizeof(uint64_t) + _ranks.size() * sizeof(uint64_t) + _fallback.size() * 2 * sizeof(uint64_t);
+	}
+
+	double bitsPerKey() const {
+		return _size == 0 ? 0 : 8.0 * memoryBytes() / _size;
+	}
+
+private:
+	static constexpr size_t RankWords = 8;      // Words between popcount samples
+
+	struct Level {
+		uint64_t offset;                        // First word in _bits
+		uint64_t bits;
+	};
+
+	std::vector<uint64_t> _bits;
+	std::vector<uint64_t> _ranks;
+	std::vector<Level> _levels;
+	std::unordered_map<uint64_t, uint64_t> _fallback;
+	size_t _size = 0;
+
+	/// <summary>
+	/// A seeded 64-bit finalizer (MurmurHash3 fmix64): nearby keys land far apart
+	/// </summary>
+	static uint64_t hash(uint64_t key, int level) {
+		uint64_t h = key ^ ((uint64_t)(level + 1) * 0x9E3779B97F4A7C15ull);
+		h ^= h >> 33;
+		h *= 0xFF51AFD7ED558CCDull;
+		h ^= h >> 33;
+		h *= 0xC4CEB9FE1A85EC53ull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	uint64_t rank(uint64_t position) const {
+		const size_t word = (size_t)(position / 64);
+		uint64_t r = _ranks[word / RankWords];
+		for (size_t w = word / RankWords * RankWords; w < word; ++w) {
+			r += std::popcount(_bits[w]);
+		}
+		return r + std::popcount(_bits[word] & ((uint64_t(1) << (position % 64)) - 1));
+	}
+
+	/// <summary>
+	/// Hash the keys into one level's bits and keep the bits hit exactly once
+	/// </summary>
+	/// <returns>Keys that collided, for the next level</returns>
+	std::vector<uint64_t> buildLevel(const std::vector<uint64_t>& keys, int level, uint64_t words, int threads) {
+		const int workers = std::max(1, threads);
+		const uint64_t bits = words * 64;
+		std::vector<std::atomic<uint64_t>> hit(words);
+		std::vector<std::atomic<uint64_t>> collided(words);
+		std::vector<std::vector<uint64_t>> next(workers);
+
+		// Each worker takes a contiguous share of the keys, for both passes
+		auto share = [&](int worker, auto body) {
+			const size_t begin = keys.size() * worker / workers;
+			const size_t end = keys.size() * (worker + 1) / workers;
+			for (size_t i = begin; i < end; ++i) {
+				body(worker, keys[i], hash(keys[i], level) % bits);
+			}
+		};
+		auto inParallel = [&](auto body) {
+			std::vector<std::thread> pool;
+			for (int t = 1; t < workers; ++t) {
+				pool.emplace_back([&, t]() { share(t, body); });
+			}
+			share(0, body);
+			for (std::thread& worker : pool) {
+				worker.join();
+			}
+		};
+
+		inParallel([&](int, uint64_t, uint64_t position) {
+			const uint64_t bit = uint64_t(1) << (position % 64);
+			if ((hit[position / 64].fetch_or(bit, std::memory_order_relaxed) & bit) != 0) {
+				collided[position / 64].fetch_or(bit, std::memory_order_relaxed);
+			}
+		});
+		inParallel([&](int worker, uint64_t key, uint64_t position) {
+			if ((collided[position / 64].load(std::memory_order_relaxed) >> (position % 64)) & 1) {
+				next[worker].push_back(key);
+			}
+		});
+
+		for (uint64_t w = 0; w < words; ++w) {
+			_bits.push_back(hit[w].load(std::memory_order_relaxed) & ~collided[w].load(std::memory_order_relaxed));
+		}
+		std::vector<uint64_t> remaining;
+		for (const auto& part : next) {
+			remaining.insert(remaining.end(), part.begin(), part.end());
+		}
+		return remaining;
+	}
+};
@@ -0,0 +1,103 @@
+﻿// Perft.h : Move generation correctness and speed harness for Cube222
+//
+// Like perft in chess engines: count the distinct states first reached at each
+// depth from the solved cube and compare with the known distance distribution
+// of the 2x2x2 (DBL corner fixed, 3674160 states). Any bug in the move tables,
+// the state encoding or the duplicate detection shows up as a wrong count, and
+// the time per level measures the whole move/encode/dedup pipeline.
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <chrono>
+
+#include "Cube.h"
+
+class Perft {
+public:
+	using Facelets = Cube222::Facelets;
+
+	/// <summary>
+	/// Result of one depth
+	/// </summary>
+	struct Level {
+		int depth;
+		uint64_t states;        // Distinct states first reached at this depth
+		uint64_t nodes;         // Moves applied to reach them
+		double seconds;
+	};
+
+	/// <summary>
+	/// Number of states at each distance from solved, from the literature
+	/// </summary>
+	static const std::vector<uint64_t>& expected(Metric metric) {
+		static const std::vector<uint64_t> quarterTurns = {
+			1, 6, 27, 120, 534, 2256, 8969, 33058, 114149, 360508, 930588, 1350852, 782536, 90280, 276
+		};
+		static const std::vector<uint64_t> halfTurns = {
+			1, 9, 54, 321, 1847, 9992, 50136, 227536, 870072, 1887748, 623800, 2644
+		};
+		return metric == HALF_TURN ? halfTurns : quarterTurns;
+	}
+
+	/// <summary>
+	/// Breadth first expansion from the solved state, one level per depth. Visited states are
+	/// one bit each, indexed by Cube222::encodeFacelets.
+	/// </summary>
+	/// <param name="maxDepth">Deepest level, stops earlier once no new state is found</param>
+	/// <param name="metric">Quarter turns only, or quarter and half turns</param>
+	/// <returns>Levels 0 to the last one reached</returns>
+	static std::vector<Level> run(int maxDepth, Metric metric) {
+		static const std::vector<Rotation> quarterTurns = { U, R, F, UI, RI, FI };
+		static const std::vector<Rotation> faceTurns = { U, R, F, UI, RI, FI, U2, R2, F2 };
+		const std::vector<Rotation>& moves = metric == HALF_TURN ? faceTurns : quarterTurns;
+
+		std::vector<uint64_t> visited((Cube222::StateCount + 63) / 64);
+		std::vector<Facelets> frontier = { Cube222().getFacelets() };
+		const uint32_t solved = Cube222::encodeFacelets(frontier[0]);
+		visited[solved / 64] |= uint64_t(1) << (solved % 64);
+
+		std::vector<Level> levels = { { 0, 1, 0, 0 } };
+		for (int depth = 1; depth <= maxDepth; ++depth) {
+			TRACE_SPAN_VALUE("perft", "level", depth);
+			auto begin = std::chrono::steady_clock::now();
+			std::vector<Facelets> next;
+			uint64_t nodes = 0;
+			for (const Facelets& state : frontier) {
+				for (Rotation move : moves) {
+					const Facelets child = Cube222::permute(state, Cube222::moveFacelets[move]);
+					const uint32_t index = Cube222::encodeFacelets(child);
+					++nodes;
+					uint64_t& word = visited[index / 64];
+					const uint64_t bit = uint64_t(1) << (index % 64);
+					if ((word & bit) == 0) {
+						word |= bit;
+						next.push_back(child);
+					}
+				}
+			}
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
+			if (next.empty()) {
+				break;
+			}
+			levels.push_back({ depth, next.size(), nodes, elapsed.count() });
+			frontier.swap(next);
+		}
+		return levels;
+	}
+
+	/// <summary>
+	/// Compare the levels with the known distribution
+	/// </summary>
+	/// <returns>Depth of the first wrong count, -1 if all match</returns>
+	static int check(const std::vector<Level>& levels, Metric metric) {
+		const std::vector<uint64_t>& known = expected(metric);
+		for (const Level& level : levels) {
+			if (level.depth >= (int)known.size() || level.states != known[level.depth]) {
+				return level.depth;
+			}
+		}
+		return -1;
+	}
+};
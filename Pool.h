@@ -0,0 +1,81 @@
+﻿// Pool.h : Per-thread pool of reusable objects
+//
+// A Cube holds its stickers in nested vectors, so every copy made with new
+// allocates dozens of blocks. Cube222::copy() takes its copies from a pool, which
+// hands them out with a handle and gets them back when it is dropped; a returned
+// object is overwritten by assignment on its next use, and assigning a cube of
+// the same shape reuses the vectors' storage, so once the pool is warm a copy
+// calls no malloc at all. Each thread has its own pool (local()), with no lock;
+// a handle must be dropped on the thread that acquired it and before that thread
+// exits.
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+template <typename T>
+class ObjectPool {
+public:
+	/// <summary>
+	/// Returns the object to its pool instead of deleting it
+	/// </summary>
+	struct Release {
+		ObjectPool* pool;
+
+		void operator()(T* object) const {
+			pool->_free.push_back(object);
+		}
+	};
+	using Handle = std::unique_ptr<T, Release>;
+
+	ObjectPool() = default;
+	ObjectPool(const ObjectPool&) = delete;
+	ObjectPool& operator=(const ObjectPool&) = delete;
+
+	~ObjectPool() {
+		for (T* object : _free) {
+			delete object;
+		}
+	}
+
+	/// <summary>
+	/// The calling thread's pool
+	/// </summary>
+	static ObjectPool& local() {
+		thread_local ObjectPool pool;
+		return pool;
+	}
+
+	/// <summary>
+	/// A copy of source, made in a returned object if there is one
+	/// </summary>
+	Handle acquire(const T& source) {
+		if (_free.empty()) {
+			++_created;
+			// Room to take every object back without growing the free list
+			_free.reserve(_created);
+			return Handle(new T(source), Release{ this });
+		}
+		T* object = _free.back();
+		_free.pop_back();
+		*object = source;
+		return Handle(object, Release{ this });
+	}
+
+	/// <summary>
+	/// Objects allocated so far, in use or free
+	/// </summary>
+	uint64_t created() const {
+		return _created;
+	}
+
+	size_t available() const {
+		return _free.size();
+	}
+
+private:
+	std::vector<T*> _free;
+	uint64_t _created = 0;
+};
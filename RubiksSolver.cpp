@@ -1,628 +1,643 @@
 ﻿#include "RubiksSolver.h"
 
+#include <csignal>
+#include <fstream>
+#include <thread>
+
 using namespace std;
 
-enum Color { RED, BLUE, ORANGE, GREEN, WHITE, YELLOW, UNDEFINED };
-enum Faces { TOP, FRONT, RIGHT, BOTTOM, BACK, LEFT, NONE };
-enum Rotation { U, D, R, L, F, B, UI, DI, RI, LI, FI, BI };
-
-std::map<char, Color> charToColor = {
-	{'R', RED}, {'B', BLUE}, {'O', ORANGE}, {'G', GREEN}, {'W', WHITE}, {'Y', YELLOW}
-};
-
-std::map<std::string, Faces> tagToFace = {
-	{"-ft", TOP}, {"-ff", FRONT}, {"-fr", RIGHT}, {"-fb", BOTTOM}, {"-fbk", BACK}, {"-fl", LEFT}
-};
-
-class Cube {
-public:
-	/// <summary>
-	/// Constructor of The Cube
-	/// </summary>
-	/// <param name="initialColor">Initial Color</param>
-	/// <param name="cRow">Row Count For Each Face</param>
-	/// <param name="cCol">Col Count For Each Face</param>
-	/// <param name="cFace">Face Count</param>
-	Cube(Color initialColor, int cRow, int cCol, int cFace)
-		: _cRow(cRow), _cCol(cCol), _cFace(cFace),
-		_matrix(cFace, std::vector<std::vector<Color>>(cCol, std::vector<Color>(cRow, initialColor))) {
-
-		setColorsToInitState();
-	}
-
-	/// <summary>
-	/// Goto init state
-	/// </summary>
-	void setColorsToInitState() {
-		setColor(FRONT, BLUE);
-		setColor(RIGHT, RED);
-		setColor(TOP, YELLOW);
-		setColor(BOTTOM, WHITE);
-		setColor(BACK, GREEN);
-		setColor(LEFT, ORANGE);
-		_rotations.clear();
-	}
-
-	void saveInitState() {
-		_initMatrix = _matrix;
-	}
-
-	void reset() {
-		_matrix = _initMatrix;
-		_rotations.clear();
-	}
-
-	/// <summary>
-	/// Function to set the colors of the face
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="colors">Colors</param>
-	void setColor(Faces face, const std::vector<Color>& colors) {
-		for (int i = 0; i < _cRow; ++i) {
-			for (int j = 0; j < _cCol; ++j) {
-				int idx = i * _cCol + j;  // Flatten the row/col to index
-				if (idx < colors.size()) {
-					_matrix[face][i][j] = colors[idx];
-				}
-			}
-		}
+#ifdef RUBIKS_ALLOC_AUDIT
+// Every heap allocation is reported to AllocAudit, which counts the ones inside the searches
+#include "AllocHooks.h"
+#endif
+
+// Ctrl+C stops a running search, which then reports its best partial result
+CancellationToken searchCancellation;
+
+extern "C" void onInterrupt(int) {
+	searchCancellation.cancel();
+}
+
+/// <summary>
+/// Solve with the symmetry-reduced distance table
+/// </summary>
+/// <param name="cube">Cube to solve, the solution is applied to it</param>
+/// <param name="metric">Metric the solution is optimal in</param>
+/// <param name="solution">Solution found</param>
+/// <returns>False if the state is not in the table</returns>
+bool solveWithTable(Cube222& cube, Metric metric, std::vector<Rotation>& solution) {
+	auto begin_time = std::chrono::steady_clock::now();
+	SymmetryTable table;
+	table.build(metric);
+	std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - begin_time;
+	std::cout << "Table of " << table.classCount() << " symmetry classes (" << table.memoryBytes() << " bytes) built in " << buildTime.count() << " seconds.\n";
+
+	TRACE_SPAN("solver", "table walk");
+	if (!table.solve(cube.getFacelets(), solution)) {
+		std::cout << "State not found in the table.\n";
+		return false;
 	}
-
-	/// <summary>
-	/// Function to set the color of the face
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="color">Color</param>
-	void setColor(Faces face, Color color) {
-		for (int r = 0; r < _cRow; r++) {
-			for (int c = 0; c < _cCol; c++) {
-				setColor(face, r, c, color);
-			}
-		}
+	// A quarter turn table walk gives a half turn as two quarter turns
+	solution = Cube::simplifySolution(solution);
+	std::chrono::duration<double> timeTaken = std::chrono::steady_clock::now() - begin_time;
+	std::cout << "Solved in " << timeTaken.count() << " seconds.\n";
+	std::cout << "Solution: ";
+	for (Rotation move : solution) {
+		std::cout << Cube::rotationToString(move) << " ";
 	}
-
-	/// <summary>
-	/// Function to set the color of a specific cell
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="row">Row</param>
-	/// <param name="col">Column</param>
-	/// <param name="color">Color</param>
-	void setColor(Faces face, int row, int col, Color color) {
-		if (row >= 0 && row < _cRow && col >= 0 && col < _cCol) {
-			_matrix[face][row][col] = color;
-		}
-		else {
-			std::cerr << "Index out of bounds error." << std::endl;
+	std::cout << "\n";
+	cube.applySolution(solution);
+	return true;
+}
+
+/// <summary>
+/// Solve with the full distance table, built on several threads or loaded from a file
+/// </summary>
+/// <param name="cube">Cube to solve, the solution is applied to it</param>
+/// <param name="metric">Metric the solution is optimal in</param>
+/// <param name="threads">Threads that build the table</param>
+/// <param name="tablePath">Table file written by -build-table, empty to build the table</param>
+/// <param name="solution">Solution found</param>
+/// <returns>False if the table cannot be loaded or the state is not in it</returns>
+bool solveWithDistanceTable(Cube222& cube, Metric metric, int threads, const std::string& tablePath, std::vector<Rotation>& solution) {
+	auto begin_time = std::chrono::steady_clock::now();
+	auto table = std::make_unique<DistanceTable>();
+	if (tablePath.empty()) {
+		table->build(metric, threads);
+		std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - begin_time;
+		std::cout << "Table of " << DistanceTable::Size << " states (" << table->memoryBytes() << " bytes) built on " << threads << " threads in " << buildTime.count() << " seconds.\n";
+	}
+	else {
+		if (!table->load(tablePath, metric)) {
+			return false;
 		}
+		std::chrono::duration<double> loadTime = std::chrono::steady_clock::now() - begin_time;
+		std::cout << "Table of " << DistanceTable::Size << " states loaded from " << tablePath << " in " << loadTime.count() << " seconds.\n";
 	}
 
-	/// <summary>
-	/// Function to get the color of a specific cell
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="row">Row</param>
-	/// <param name="col">Column</param>
-	/// <param name="color">Color</param>
-	/// <returns>Color</returns>
-	Color getColor(Faces face, int row, int col) const {
-		if (row >= 0 && row < _cRow && col >= 0 && col < _cCol) {
-			return _matrix[face][row][col];
+	TRACE_SPAN("solver", "table walk");
+	if (!table->solve(cube.getFacelets(), solution)) {
+		std::cout << "State not found in the table.\n";
+		return false;
+	}
+	// A quarter turn table walk gives a half turn as two quarter turns
+	solution = Cube::simplifySolution(solution);
+	std::chrono::duration<double> timeTaken = std::chrono::steady_clock::now() - begin_time;
+	std::cout << "Solved in " << timeTaken.count() << " seconds.\n";
+	std::cout << "Solution: ";
+	for (Rotation move : solution) {
+		std::cout << Cube::rotationToString(move) << " ";
+	}
+	std::cout << "\n";
+	cube.applySolution(solution);
+	return true;
+}
+
+/// <summary>
+/// Solve with the anytime two-phase solver, printing every improvement as it is found
+/// </summary>
+/// <param name="cube">Cube to solve, the best solution is applied to it</param>
+/// <param name="options">Search budgets</param>
+/// <returns>Search result</returns>
+SolveResult solveAnytime(Cube222& cube, const SolveOptions& options) {
+	SolveResult result = TwoPhaseSolver::instance().solve(cube.getFacelets(), options, [&](const SolveResult& improved) {
+		std::cout << Cube::solutionLength(improved.solution, options.metric) << " moves after " << improved.seconds << " seconds: ";
+		for (Rotation move : improved.solution) {
+			std::cout << Cube::rotationToString(move) << " ";
 		}
-		else {
-			std::cerr << "Index out of bounds error." << std::endl;
-			return Color::WHITE;  // Default return
+		std::cout << "\n";
+	});
+
+	if (result.status == INVALID_STATE) {
+		std::cout << "Search stopped (" << Cube::searchStatusToString(result.status) << "): the two-phase solver needs a valid, normalized cube.\n";
+		return result;
+	}
+	if (result.status != SOLVED) {
+		std::cout << "Search stopped (" << Cube::searchStatusToString(result.status) << ") after " << result.nodes << " nodes, " << result.seconds << " seconds.\n";
+		return result;
+	}
+	std::cout << (result.optimal ? "Optimal" : "Best") << " solution after " << result.nodes << " nodes, " << result.seconds << " seconds.\n";
+	cube.applySolution(result.solution);
+	return result;
+}
+
+/// <summary>
+/// Count the states at each depth and check them against the known distribution
+/// </summary>
+/// <param name="depth">Deepest level</param>
+/// <param name="metric">Metric</param>
+/// <returns>Exit code, 3 on a wrong count</returns>
+int runPerft(int depth, Metric metric) {
+	const std::vector<uint64_t>& known = Perft::expected(metric);
+	std::vector<Perft::Level> levels = Perft::run(depth, metric);
+	uint64_t nodes = 0;
+	double seconds = 0;
+	for (const Perft::Level& level : levels) {
+		const uint64_t expected = level.depth < (int)known.size() ? known[level.depth] : 0;
+		std::cout << "Depth " << level.depth << ": " << level.states << " states (expected " << expected << "), "
+			<< level.nodes << " nodes, " << level.seconds << " seconds";
+		if (level.seconds > 0) {
+			std::cout << ", " << (uint64_t)(level.nodes / level.seconds) << " nodes/s";
 		}
+		std::cout << (level.states == expected ? "\n" : "  MISMATCH\n");
+		nodes += level.nodes;
+		seconds += level.seconds;
 	}
+	std::cout << "Total: " << nodes << " nodes, " << seconds << " seconds, " << (uint64_t)(nodes / std::max(seconds, 1e-9)) << " nodes/s\n";
 
-	/// <summary>
-	/// Make a rotation
-	/// </summary>
-	/// <param name="r">Rotation</param>
-	virtual void applyRotation(Rotation r) {
-		_rotations.push_back(r);
-	}
-
-	/// <summary>
-	/// Utility to print the cube's configuration
-	/// </summary>
-	/// <param name="shortPrint"></param>
-	void printCube(bool shortPrint = false) {
-		std::string solvedStr = isSolved() ? "YES" : "NO";
-		std::cout << "Solved: " << solvedStr << std::endl;
-		std::cout << "Rotations: " << rotationsToString() << std::endl;
-		if (shortPrint) {
-			for (int f = 0; f < _cFace / 2; ++f) {
-				std::cout << "Face: " << faceToString((Faces)f) << std::endl;
-				for (const auto& row : _matrix[f]) {
-					for (Color color : row) {
-						std::cout << colorToString(color) << " ";
-					}
-					std::cout << std::endl;
-				}
-			}
+	const int wrong = Perft::check(levels, metric);
+	if (wrong >= 0) {
+		std::cout << "Perft failed at depth " << wrong << ".\n";
+		return 3;
+	}
+	std::cout << "Perft OK.\n";
+	return 0;
+}
+
+/// <summary>
+/// Build the full distance table and write it to a file, in memory or with an external-memory search
+/// </summary>
+/// <param name="path">Table file</param>
+/// <param name="metric">Metric</param>
+/// <param name="threads">Threads of the in-memory build</param>
+/// <param name="directory">Directory for the layer files, empty to build in memory</param>
+/// <param name="memoryMB">Memory cap of the external-memory build</param>
+/// <param name="checkpoint">File the in-memory build saves the table to after every level, empty for none</param>
+/// <param name="resume">Go on from the checkpoint</param>
+/// <returns>Exit code, 1 on a failed build or write</returns>
+int runBuildTable(const std::string& path, Metric metric, int threads, const std::string& directory, size_t memoryMB, const std::string& checkpoint, bool resume) {
+	auto begin_time = std::chrono::steady_clock::now();
+	std::vector<uint64_t> levels;
+	if (directory.empty()) {
+		auto table = std::make_unique<DistanceTable>();
+		table->build(metric, threads, checkpoint, resume);
+		if (!table->save(path)) {
+			return 1;
 		}
-		else {
-			for (int f = 0; f < _cFace; ++f) {
-				std::cout << "Face: " << faceToString((Faces)f) << std::endl;
-				for (const auto& row : _matrix[f]) {
-					for (Color color : row) {
-						std::cout << colorToString(color) << " ";
-					}
-					std::cout << std::endl;
-				}
-				std::cout << std::endl;
-			}
+		levels = table->levels();
+	}
+	else {
+		ExternalBfs search(directory, memoryMB << 20);
+		if (!search.build(metric, path)) {
+			return 1;
 		}
+		levels = search.levels();
+		std::cout << "Peak buffer memory " << search.peakBytes() << " bytes.\n";
 	}
-
-	/// <summary>
-	/// Check if tich cube is solved or not
-	/// </summary>
-	/// <returns>Solved or Not</returns>
-	inline bool isSolved() const {
-		for (size_t f = 0; f < _cFace/2; ++f) {
-			auto face = _matrix[f];
-			const Color referenceColor = face[0][0];
-			for (size_t i = 0; i < _cCol; ++i) {
-				for (size_t j = 0; j < _cRow; ++j) {
-					if (face[i][j] != referenceColor) {
-						return false;
-					}
-				}
-			}
+	std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - begin_time;
+	for (size_t depth = 0; depth < levels.size(); ++depth) {
+		std::cout << "Depth " << depth << ": " << levels[depth] << " states\n";
+	}
+	std::cout << "Table written to " << path << " in " << buildTime.count() << " seconds.\n";
+	return 0;
+}
+
+/// <summary>
+/// Solve every cube of a corpus (face strings, one per line) and report the latency
+/// percentiles per solution length. Each worker thread records into its own histograms,
+/// merged for the report. Cached solutions are returned without searching, and optimal
+/// ones found by the search are added to the cache. Every solution is then checked on its
+/// cube, a CubeBatch at a time.
+/// </summary>
+/// <param name="path">Corpus file, - for stdin</param>
+/// <param name="solver">table, or the two-phase solver for anything else</param>
+/// <param name="options">Search budgets of each solve</param>
+/// <param name="threads">Worker threads</param>
+/// <param name="cache">Solution cache, may be null</param>
+/// <returns>Exit code, 1 on an unreadable file or an unsolvable cube, 2 if a search stopped, 3 on a wrong solution</returns>
+int runBatch(const std::string& path, const std::string& solver, const SolveOptions& options, int threads, SolutionCache* cache) {
+	static constexpr int MaxLength = 20;
+	std::ifstream file;
+	if (path != "-") {
+		file.open(path);
+		if (!file) {
+			std::cout << "Cannot read " << path << std::endl;
+			return 1;
 		}
-		return true;
 	}
-
-	/// <summary>
-	/// Apply A solution to this cube
-	/// </summary>
-	/// <param name="solution">A solution array from rotations enum elements</param>
-	void applySolution(const std::vector<Rotation>& solution) {
-		for (Rotation move : solution) {
-			applyRotation(move);
+	std::istream& in = path == "-" ? std::cin : file;
+
+	std::vector<Cube222::Facelets> states;
+	std::string line;
+	Cube222::Facelets facelets;
+	while (std::getline(in, line)) {
+		if (ScrambleGenerator::parseFaceString(line, facelets)) {
+			states.push_back(facelets);
 		}
 	}
 
-	/// <summary>
-	/// Clone the cube
-	/// </summary>
-	/// <returns>The Cube</returns>
-	virtual Cube* copy() const {
-		return new Cube(WHITE, _cRow, _cCol, _cFace); // Return a new Cube allocated with new
+	// Tables are built before the clock starts, as a long running process would have them
+	SymmetryTable table;
+	if (solver == "table") {
+		table.build(options.metric);
+	}
+	else {
+		TwoPhaseSolver::instance();
 	}
 
-	/// <summary>
-	/// Depth First Search For Solve The Cube
-	/// </summary>
-	/// <param name="depth">Depth</param>
-	/// <param name="begin_time">Start Time</param>
-	virtual void dfs(int depth = 1, const std::chrono::time_point<std::chrono::steady_clock>& begin_time = std::chrono::steady_clock::now()) {
-		if (isSolved()) {
-			return;
-		}
-
-		static const std::vector<Rotation> allRotations = { U, D, R, L, F, B, UI, DI, RI, LI, FI, BI };
-		std::vector<Rotation> currentPath;
-		std::vector<std::vector<Rotation>> potentialSolutions;
-
-		// Generate all combinations of moves up to the given depth
-		generateCombinations(allRotations, depth, currentPath, potentialSolutions);
-		std::cout << potentialSolutions.size() << " combinations testing.\n";
-
-		auto endTime = std::chrono::steady_clock::now();
-		std::chrono::duration<double> timeTaken = endTime - begin_time;
-		//int printIndex = 0;
-
-		for (const auto& solution : potentialSolutions) {
-			//std::cout << "Testing: ";
-			//for (Rotation move : solution) {
-			//	std::cout << rotationToString(move) << " ";
-			//}
-			//std::cout << "\n";
-
-			//testCube->printCube(true);
-			applySolution(solution);
-			if (isSolved()) {
-				std::cout << "Solved in " << timeTaken.count() << " seconds.\n";
-				std::cout << "Solution: ";
-				for (Rotation move : solution) {
-					std::cout << rotationToString(move) << " ";
+	enum Outcome { PENDING, DONE, STOPPED, INVALID, WRONG };
+	std::vector<Cube222::Facelets> normalizedStates(states.size());
+	std::vector<std::vector<Rotation>> solutions(states.size());
+	std::vector<Outcome> outcomes(states.size(), PENDING);
+	std::vector<std::vector<LatencyHistogram>> histograms(std::max(1, threads), std::vector<LatencyHistogram>(MaxLength + 1));
+	std::atomic<size_t> next = 0;
+
+	auto work = [&](std::vector<LatencyHistogram>& byLength) {
+		for (size_t i = next++; i < states.size(); i = next++) {
+			auto begin = std::chrono::steady_clock::now();
+			Cube222 cube;
+			cube.setFacelets(states[i]);
+			if (!cube.validate().isValid() || !cube.normalizeOrientation()) {
+				outcomes[i] = INVALID;
+				continue;
+			}
+			const Cube222::Facelets normalized = cube.getFacelets();
+			normalizedStates[i] = normalized;
+			if (cache != nullptr && cache->lookup(normalized, options.metric, solutions[i])) {
+				outcomes[i] = DONE;
+			}
+			else if (solver == "table") {
+				outcomes[i] = table.solve(normalized, solutions[i]) ? DONE : STOPPED;
+				if (cache != nullptr && outcomes[i] == DONE) {
+					cache->store(normalized, options.metric, solutions[i]);
 				}
-				std::cout << "\n";
-				return;
 			}
-			reset();
+			else {
+				SolveResult result = TwoPhaseSolver::instance().solve(normalized, options);
+				solutions[i] = result.solution;
+				outcomes[i] = result.status == SOLVED ? DONE : result.status == INVALID_STATE ? INVALID : STOPPED;
+				if (cache != nullptr && result.optimal) {
+					cache->store(normalized, options.metric, solutions[i]);
+				}
+			}
+			const uint64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+			byLength[std::min(Cube::solutionLength(solutions[i], options.metric), MaxLength)].record(nanoseconds);
 		}
+	};
 
-		std::cout << timeTaken.count() << " seconds elapsed.\nIncreasing depth to " << depth + 1 << ". Continue search...\n";
-		dfs(depth + 1, begin_time);
+	auto begin = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (size_t t = 1; t < histograms.size(); ++t) {
+		workers.emplace_back(work, std::ref(histograms[t]));
 	}
+	work(histograms[0]);
+	for (std::thread& worker : workers) {
+		worker.join();
+	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - begin;
 
-protected:
-
-	int _cRow;
-	int _cCol;
-	int _cFace;
-
-	std::vector<std::vector<std::vector<Color>>> _matrix;
-	std::vector<std::vector<std::vector<Color>>> _initMatrix;
-	std::vector<Rotation> _rotations;
-
-	/// <summary>
-	/// Rotate One face of the Cube
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="clockwise">ClockWise or Counter Clock Wise</param>
-	virtual void rotateFace(Faces face, bool clockwise) { };
-
-	void generateCombinations(const std::vector<Rotation>& allRotations, int depth, std::vector<Rotation>& currentPath, std::vector<std::vector<Rotation>>& results) {
-		if (depth == 0) {
-			results.push_back(currentPath);
-			return;
-		}
-
-		for (Rotation r : allRotations) {
-			currentPath.push_back(r);
-			generateCombinations(allRotations, depth - 1, currentPath, results);
-			currentPath.pop_back();
+	auto checkBegin = std::chrono::steady_clock::now();
+	std::vector<size_t> solved;
+	for (size_t i = 0; i < states.size(); ++i) {
+		if (outcomes[i] == DONE) {
+			solved.push_back(i);
 		}
 	}
-
-	//void generateCombinations(const std::vector<Rotation>& allRotations, int depth, std::vector<std::vector<Rotation>>& results) {
-	//	std::stack<std::vector<Rotation>> stk;
-	//	stk.push({});  // start with an empty path
-
-	//	while (!stk.empty()) {
-	//		std::vector<Rotation> currentPath = stk.top();
-	//		stk.pop();
-
-	//		if (currentPath.size() == depth) {
-	//			results.push_back(currentPath);
-	//		}
-	//		else {
-	//			for (Rotation r : allRotations) {
-	//				std::vector<Rotation> newPath = currentPath;
-	//				newPath.push_back(r);
-	//				stk.push(newPath);
-	//			}
-	//		}
-	//	}
-	//}
-
-	/// <summary>
-	/// Convert Rotations Log to string
-	/// </summary>
-	/// <returns>Rotation String</returns>
-	std::string rotationsToString() {
-		std::string retVal = "";
-		for (Rotation r : _rotations) {
-			retVal.append(rotationToString(r) + " ");
+	std::vector<Cube222::Facelets> checkedStates;
+	std::vector<std::vector<Rotation>> checkedSolutions;
+	for (size_t i : solved) {
+		checkedStates.push_back(normalizedStates[i]);
+		checkedSolutions.push_back(solutions[i]);
+	}
+	for (size_t failure : CubeBatch::checkSolutions(checkedStates, checkedSolutions)) {
+		outcomes[solved[failure]] = WRONG;
+	}
+	std::chrono::duration<double> checkTime = std::chrono::steady_clock::now() - checkBegin;
+
+	int exitCode = 0;
+	for (size_t i = 0; i < states.size(); ++i) {
+		std::cout << i + 1 << ": ";
+		if (outcomes[i] == INVALID) {
+			std::cout << "unsolvable\n";
+			exitCode = 1;
+			continue;
 		}
-		return retVal;
-	}
-
-	/// <summary>
-	/// Convert Rotation enum to string
-	/// </summary>
-	/// <param name="r">Rotation</param>
-	/// <returns>String On the Rotation in the Enum</returns>
-	std::string rotationToString(Rotation r) {
-		switch (r)
-		{
-		case U:		return "U";
-		case D:		return "D";
-		case R:		return "R";
-		case L:		return "L";
-		case F:		return "F";
-		case B:		return "B";
-		case UI:	return "UI";
-		case DI:	return "DI";
-		case RI:	return "RI";
-		case LI:	return "LI";
-		case FI:	return "FI";
-		case BI:	return "BI";
-		default:	return "X";
+		for (Rotation move : solutions[i]) {
+			std::cout << Cube::rotationToString(move) << " ";
 		}
-	}
-
-	/// <summary>
-	/// Convert Color enum to string
-	/// </summary>
-	/// <param name="color">Color</param>
-	/// <param name="shortPrint">Short Print: For Small Console Output</param>
-	/// <returns>String Of the Color Enum</returns>
-	std::string colorToString(Color color, bool shortPrint = false) {
-		if (shortPrint) {
-			switch (color) {
-			case RED:    return "R";
-			case BLUE:   return "B";
-			case ORANGE: return "O";
-			case GREEN:  return "G";
-			case WHITE:  return "W";
-			case YELLOW: return "Y";
-			default:     return "U";
-			}
+		std::cout << (outcomes[i] == STOPPED ? "(stopped)\n" : outcomes[i] == WRONG ? "(does not solve the cube)\n" : "\n");
+		if (outcomes[i] == WRONG) {
+			exitCode = 3;
 		}
-		else {
-			switch (color) {
-			case RED:    return "RED";
-			case BLUE:   return "BLUE";
-			case ORANGE: return "ORANGE";
-			case GREEN:  return "GREEN";
-			case WHITE:  return "WHITE";
-			case YELLOW: return "YELLOW";
-			default:     return "UNKNOWN";
-			}
+		else if (outcomes[i] == STOPPED && exitCode == 0) {
+			exitCode = 2;
 		}
 	}
 
-	/// <summary>
-	/// Convert Faces enum to string
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="shortPrint">Short Print: For Small Console Output</param>
-	/// <returns>String Of the Faces Enum</returns>
-	std::string faceToString(Faces face, bool shortPrint = false) {
-		if (shortPrint) {
-			switch (face) {
-			case FRONT:  return "F";
-			case RIGHT:  return "R";
-			case BACK:   return "B";
-			case LEFT:   return "L";
-			case TOP:    return "T";
-			case BOTTOM: return "B";
-			default:     return "U";
-			}
-		}
-		else {
-			switch (face) {
-			case FRONT:  return "FRONT";
-			case RIGHT:  return "RIGHT";
-			case BACK:   return "BACK";
-			case LEFT:   return "LEFT";
-			case TOP:    return "TOP";
-			case BOTTOM: return "BOTTOM";
-			default:     return "UNKNOWN";
-			}
+	// Merge the per-thread histograms, per solution length and overall
+	std::vector<LatencyHistogram> byLength(MaxLength + 1);
+	LatencyHistogram all;
+	for (const auto& perThread : histograms) {
+		for (int length = 0; length <= MaxLength; ++length) {
+			byLength[length].merge(perThread[length]);
+			all.merge(perThread[length]);
 		}
 	}
-};
-
-class Cube222 : public Cube {
-public:
-
-	/// <summary>
-	/// Constructor of The Cube 2x2x2
-	/// </summary>
-	/// <param name="initialColor">Initial Color</param>
-	/// <param name="cRow">Row Count For Each Face</param>
-	/// <param name="cCol">Col Count For Each Face</param>
-	/// <param name="cFace">Face Count</param>
-	Cube222(Color initialColor = Color::WHITE, int cRow = 2, int cCol = 2, int cFace = 6) :
-		Cube(initialColor, cRow, cCol, cFace) {
-	}
-
-	Cube* copy() const override {
-		Cube222* newCube = new Cube222(*this);  // Dynamically allocate a new Cube222
-		newCube->_matrix = this->_matrix;       // Explicitly copy the matrix
-		return newCube;                         // Return as a pointer to Cube
-	}
-
-	/// <summary>
-	/// Make a rotation
-	/// </summary>
-	/// <param name="r">Rotation</param>
-	void applyRotation(Rotation r) override {
-		std::vector<Color> tempRow;
-		std::vector<Color> tempColumn(_cCol);
-		std::vector<Color> tempTop(_cCol);  // Top edge of the top face (temporarily stores top of top face)
-		if (r == U || r == UI) {
-			// Rotate the top face
-			rotateFace(TOP, r == U);
-			// Cycle the top rows
-			tempRow = _matrix[FRONT][0]; // Copy front top row
-			if (r == U) { // Clockwise
-				_matrix[FRONT][0] = _matrix[RIGHT][0];
-				_matrix[RIGHT][0] = _matrix[BACK][0];
-				_matrix[BACK][0] = _matrix[LEFT][0];
-				_matrix[LEFT][0] = tempRow;
-			}
-			else { // Counter-clockwise (UI)
-				_matrix[FRONT][0] = _matrix[LEFT][0];
-				_matrix[LEFT][0] = _matrix[BACK][0];
-				_matrix[BACK][0] = _matrix[RIGHT][0];
-				_matrix[RIGHT][0] = tempRow;
-			}
+
+	std::cout << states.size() << " cubes in " << elapsed.count() << " seconds on " << histograms.size() << " threads.\n";
+	std::cout << solved.size() << " solutions checked in " << checkTime.count() << " seconds.\n";
+	std::cout << "Latency in microseconds:\n";
+	std::cout << std::setw(6) << "moves" << std::setw(9) << "count" << std::setw(11) << "p50" << std::setw(11) << "p90"
+		<< std::setw(11) << "p99" << std::setw(11) << "p99.9" << std::setw(11) << "max" << "\n";
+	auto report = [](const std::string& label, const LatencyHistogram& histogram) {
+		std::cout << std::setw(6) << label << std::setw(9) << histogram.count() << std::fixed << std::setprecision(1);
+		for (double p : { 50.0, 90.0, 99.0, 99.9 }) {
+			std::cout << std::setw(11) << histogram.percentile(p) / 1000.0;
 		}
-		else if (r == D || r == DI) {
-			// Rotate the bottom face
-			rotateFace(BOTTOM, r == D);
-			// Cycle te bottom rows
-			tempRow = _matrix[FRONT][1]; // Copy front down row
-			if (r == D) { // Clockwise
-				_matrix[FRONT][1] = _matrix[RIGHT][1];
-				_matrix[RIGHT][1] = _matrix[BACK][1];
-				_matrix[BACK][1] = _matrix[LEFT][1];
-				_matrix[LEFT][1] = tempRow;
-			}
-			else { // Counter-clockwise
-				_matrix[FRONT][1] = _matrix[LEFT][1];
-				_matrix[LEFT][1] = _matrix[BACK][1];
-				_matrix[BACK][1] = _matrix[RIGHT][1];
-				_matrix[RIGHT][1] = tempRow;
-			}
+		std::cout << std::setw(11) << histogram.max() / 1000.0 << std::defaultfloat << std::setprecision(6) << "\n";
+	};
+	for (int length = 0; length <= MaxLength; ++length) {
+		if (byLength[length].count() > 0) {
+			report(std::to_string(length), byLength[length]);
 		}
-		else if (r == L || r == LI) {
-			// Rotate the left face
-			rotateFace(LEFT, r == L);
-			// Cycling the columns for L or LI rotation
-			for (int i = 0; i < _cCol; i++) {  // Since it's a 2x2 cube
-				tempColumn[i] = _matrix[TOP][i][0];  // Store the left column of the top face
-			}
+	}
+	report("all", all);
+	if (cache != nullptr) {
+		std::cout << "Cache: " << cache->hits() << " hits, " << cache->misses() << " misses (" << cache->rejected() << " rejected), " << cache->size() << " entries.\n";
+	}
+	return exitCode;
+}
 
-			if (r == L) { // Clockwise
-				for (int i = 0; i < _cCol; i++) {
-					_matrix[TOP][i][0] = _matrix[BACK][1 - i][1];  // Back to top, flipped vertically
-					_matrix[BACK][1 - i][1] = _matrix[BOTTOM][i][0];  // Bottom to back, flipped vertically
-					_matrix[BOTTOM][i][0] = _matrix[FRONT][i][0];  // Front to bottom
-					_matrix[FRONT][i][0] = tempColumn[i];  // Top to front
+int main(int argc, char* argv[]) {
+	TraceSession trace;
+	Cube222 cube;
+	std::string solver = "dfs";
+	SolveOptions options;
+	options.cancel = &searchCancellation;
+	int scrambleCount = 0;
+	int perftDepth = 0;
+	int scrambleLength = 0;
+	uint64_t seed = 1;
+	std::string stats;
+	std::string traceFile;
+	std::string batchFile;
+	std::string cacheFile;
+	int endgameDepth = 0;
+	int threads = 1;
+	std::string tableFile;
+	std::string buildTableFile;
+	std::string externalDirectory;
+	size_t memoryMB = 64;
+	std::string checkpointFile;
+	double checkpointInterval = 60;
+	bool resume = false;
+	std::string setupMoves;
+
+	{
+		TRACE_SPAN("main", "parse");
+		for (int i = 1; i < argc; i += 2) {
+			if (i + 1 < argc) {
+				std::string tag = argv[i];
+				std::string values = argv[i + 1];
+				std::vector<Color> colors;
+
+				if (tag == "-solver") {
+					solver = values;
+					continue;
 				}
-			}
-			else { // Counter-clockwise
-				for (int i = 0; i < _cCol; i++) {
-					_matrix[TOP][i][0] = _matrix[FRONT][i][0];  // Front to top
-					_matrix[FRONT][i][0] = _matrix[BOTTOM][i][0];  // Bottom to front
-					_matrix[BOTTOM][i][0] = _matrix[BACK][1 - i][1];  // Back to bottom, flipped vertically
-					_matrix[BACK][1 - i][1] = tempColumn[i];  // Top to back, flipped vertically
+				if (tag == "-timeout") {
+					options.timeLimit = std::stod(values);
+					continue;
 				}
-			}
-		}
-		else if (r == R || r == RI) {
-			// Rotate the right face
-			rotateFace(RIGHT, r == R);
-
-			// Cycling the columns for R or RI rotation
-			for (int i = 0; i < _cCol; i++) {
-				tempColumn[i] = _matrix[TOP][i][1];  // Store the right column of the top face
-			}
-
-			if (r == R) { // Clockwise
-				for (int i = 0; i < _cCol; i++) {
-					_matrix[TOP][i][1] = _matrix[FRONT][i][1];  // Front to top
-					_matrix[FRONT][i][1] = _matrix[BOTTOM][i][1];  // Bottom to front
-					_matrix[BOTTOM][i][1] = _matrix[BACK][1 - i][0];  // Back (flipped vertically) to bottom
-					_matrix[BACK][1 - i][0] = tempColumn[i];  // Top to back (flipped vertically)
+				if (tag == "-maxnodes") {
+					options.maxNodes = std::stoull(values);
+					continue;
 				}
-			}
-			else { // Counter-clockwise (RI)
-				for (int i = 0; i < _cCol; i++) {
-					_matrix[TOP][i][1] = _matrix[BACK][1 - i][0];  // Back (flipped vertically) to top
-					_matrix[BACK][1 - i][0] = _matrix[BOTTOM][i][1];  // Bottom to back (flipped vertically)
-					_matrix[BOTTOM][i][1] = _matrix[FRONT][i][1];  // Front to bottom
-					_matrix[FRONT][i][1] = tempColumn[i];  // Top to front
+				if (tag == "-maxdepth") {
+					options.maxDepth = std::stoi(values);
+					continue;
 				}
-			}
-		}
-		else if (r == F || r == FI) {
-			// Rotate the front face
-			rotateFace(FRONT, r == F);
-
-			// Temporary storage for edge swapping
-			for (int i = 0; i < _cCol; ++i) {
-				tempTop[i] = _matrix[TOP][_cRow - 1][i];  // Capture bottom row of top face
-			}
-
-			if (r == F) {  // Clockwise
-				// Move columns of left to bottom of top, right to top of bottom, and so forth
-				for (int i = 0; i < _cCol; ++i) {
-					_matrix[TOP][_cRow - 1][i] = _matrix[LEFT][_cCol - 1 - i][_cRow - 1];  // Left to top (rotated)
-					_matrix[LEFT][_cCol - 1 - i][_cRow - 1] = _matrix[BOTTOM][0][i];     // Bottom to left (rotated)
-					_matrix[BOTTOM][0][i] = _matrix[RIGHT][i][0];                  // Right to bottom
-					_matrix[RIGHT][i][0] = tempTop[_cCol - 1 - i];                     // Top to right (rotated)
+				if (tag == "-metric") {
+					options.metric = values == "htm" ? HALF_TURN : QUARTER_TURN;
+					continue;
 				}
-			}
-			else {  // Counter-Clockwise (FI)
-				// Move columns of right to bottom of top, left to top of bottom, and so forth
-				for (int i = 0; i < _cCol; ++i) {
-					_matrix[TOP][_cRow - 1][i] = _matrix[RIGHT][i][0];               // Right to top
-					_matrix[RIGHT][i][0] = _matrix[BOTTOM][0][_cCol - 1 - i];          // Bottom to right (rotated)
-					_matrix[BOTTOM][0][_cCol - 1 - i] = _matrix[LEFT][_cCol - 1 - i][_cRow - 1]; // Left to bottom (rotated)
-					_matrix[LEFT][_cCol - 1 - i][_cRow - 1] = tempTop[i];                // Top to left
+				if (tag == "-scramble") {
+					scrambleCount = std::stoi(values);
+					continue;
+				}
+				if (tag == "-length") {
+					scrambleLength = std::stoi(values);
+					continue;
+				}
+				if (tag == "-seed") {
+					seed = std::stoull(values);
+					continue;
+				}
+				if (tag == "-perft") {
+					perftDepth = std::stoi(values);
+					continue;
+				}
+				if (tag == "-stats") {
+					stats = values;
+					continue;
+				}
+				if (tag == "-trace") {
+					traceFile = values;
+					continue;
+				}
+				if (tag == "-batch") {
+					batchFile = values;
+					continue;
+				}
+				if (tag == "-endgame") {
+					endgameDepth = std::stoi(values);
+					continue;
+				}
+				if (tag == "-cache") {
+					cacheFile = values;
+					continue;
+				}
+				if (tag == "-threads") {
+					threads = std::stoi(values);
+					continue;
+				}
+				if (tag == "-table") {
+					tableFile = values;
+					continue;
+				}
+				if (tag == "-build-table") {
+					buildTableFile = values;
+					continue;
+				}
+				if (tag == "-external") {
+					externalDirectory = values;
+					continue;
+				}
+				if (tag == "-memory") {
+					memoryMB = std::stoul(values);
+					continue;
+				}
+				if (tag == "-checkpoint") {
+					checkpointFile = values;
+					continue;
+				}
+				if (tag == "-checkpoint-interval") {
+					checkpointInterval = std::stod(values);
+					continue;
+				}
+				if (tag == "-resume") {
+					checkpointFile = values;
+					resume = true;
+					continue;
+				}
+				if (tag == "-apply") {
+					setupMoves = values;
+					continue;
+				}
+				if (tag == "-alloc-audit") {
+#ifdef RUBIKS_ALLOC_AUDIT
+					AllocAudit::setAbort(values == "abort");
+#else
+					std::cout << "-alloc-audit needs a build with -DRUBIKS_ALLOC_AUDIT=ON" << std::endl;
+#endif
+					continue;
 				}
-			}
-		}
-		else if (r == B || r == BI) {
-			// rotate the back face
-			rotateFace(BACK, r == B);
 
-			// Temporary storage for edge swapping
-			for (int i = 0; i < _cCol; ++i) {
-				tempTop[i] = _matrix[TOP][0][i];  // Capture top row of top face
-			}
+				// Convert string of colors to vector of Color enums
+				std::transform(values.begin(), values.end(), std::back_inserter(colors),
+					[](char c) -> Color { return charToColor.count(c) > 0 ? charToColor[c] : UNDEFINED; });
 
-			if (r == B) {  // Clockwise
-				// Move columns of right to top of top, left to bottom of bottom, and so forth
-				for (int i = 0; i < _cCol; ++i) {
-					_matrix[TOP][0][i] = _matrix[LEFT][_cCol - 1 - i][0];   // Left to top (rotated)
-					_matrix[LEFT][_cCol - 1 - i][0] = _matrix[BOTTOM][_cRow - 1][_cCol - 1 - i];  // Bottom to left (rotated)
-					_matrix[BOTTOM][_cRow - 1][_cCol - 1 - i] = _matrix[RIGHT][i][_cRow - 1];   // Right to bottom (not rotated but repositioned)
-					_matrix[RIGHT][i][_cRow - 1] = tempTop[_cCol - 1 - i];     // Top to right (rotated)
+				if (tagToFace.count(tag) > 0) {
+					cube.setColor(tagToFace[tag], colors);
 				}
-			}
-			else {  // Counter-Clockwise (BI)
-				// Move columns of left to top of top, right to bottom of bottom, and so forth
-				for (int i = 0; i < _cCol; ++i) {
-					_matrix[TOP][0][i] = _matrix[RIGHT][i][_cRow - 1];                // Right to top
-					_matrix[RIGHT][i][_cRow - 1] = _matrix[BOTTOM][_cRow - 1][_cCol - 1 - i];   // Bottom to right (rotated)
-					_matrix[BOTTOM][_cRow - 1][_cCol - 1 - i] = _matrix[LEFT][_cCol - 1 - i][0];   // Left to bottom (rotated)
-					_matrix[LEFT][_cCol - 1 - i][0] = tempTop[i];                          // Top to left
+				else {
+					std::cout << "Invalid face tag: " << tag << std::endl;
 				}
 			}
 		}
+	}
 
-		Cube::applyRotation(r);
-	}
-
-protected:
-	/// <summary>
-	/// Rotate One face of the Cube
-	/// </summary>
-	/// <param name="face">Face</param>
-	/// <param name="clockwise">ClockWise or Counter Clock Wise</param>
-	void rotateFace(Faces face, bool clockwise) override {
-		if (clockwise) {
-			// Rotate face 90 degrees clockwise
-			Color temp = _matrix[face][0][0];
-			_matrix[face][0][0] = _matrix[face][1][0];
-			_matrix[face][1][0] = _matrix[face][1][1];
-			_matrix[face][1][1] = _matrix[face][0][1];
-			_matrix[face][0][1] = temp;
-		}
-		else {
-			// Rotate face 90 degrees counterclockwise
-			Color temp = _matrix[face][0][0];
-			_matrix[face][0][0] = _matrix[face][0][1];
-			_matrix[face][0][1] = _matrix[face][1][1];
-			_matrix[face][1][1] = _matrix[face][1][0];
-			_matrix[face][1][0] = temp;
-		}
+	trace.open(traceFile);
 
-		Cube::rotateFace(face, clockwise);
+	// Solutions found before, with -cache - for a cache in memory only
+	SolutionCache cache;
+	if (!cacheFile.empty() && cacheFile != "-" && !cache.open(cacheFile)) {
+		return 1;
+	}
+	SolutionCache* solutionCache = cacheFile.empty() ? nullptr : &cache;
+
+	if (scrambleCount > 0) {
+		// Write a corpus instead of solving
+		TRACE_SPAN("main", "scramble");
+		ScrambleGenerator generator(seed);
+		std::cout << generator.corpus(scrambleCount, scrambleLength, options.metric);
+		return 0;
 	}
-};
 
-int main(int argc, char* argv[]) {
-	Cube222 cube;
+	if (!batchFile.empty()) {
+		TRACE_SPAN("main", "batch");
+		return runBatch(batchFile, solver, options, threads, solutionCache);
+	}
 
-	for (int i = 1; i < argc; i += 2) {
-		if (i + 1 < argc) {
-			std::string tag = argv[i];
-			std::string values = argv[i + 1];
-			std::vector<Color> colors;
+	if (perftDepth > 0) {
+		TRACE_SPAN("main", "perft");
+		return runPerft(perftDepth, options.metric);
+	}
 
-			// Convert string of colors to vector of Color enums
-			std::transform(values.begin(), values.end(), std::back_inserter(colors),
-				[](char c) -> Color { return charToColor.count(c) > 0 ? charToColor[c] : UNDEFINED; });
+	if (!buildTableFile.empty()) {
+		TRACE_SPAN("main", "build table");
+		return runBuildTable(buildTableFile, options.metric, threads, externalDirectory, memoryMB, checkpointFile, resume);
+	}
 
-			if (tagToFace.count(tag) > 0) {
-				cube.setColor(tagToFace[tag], colors);
-			}
-			else {
-				std::cout << "Invalid face tag: " << tag << std::endl;
-			}
+	if (!setupMoves.empty()) {
+		// Played on the given faces (the solved cube by default) in one permutation, e.g. to replay a scramble
+		std::istringstream in(setupMoves);
+		std::vector<Rotation> moves;
+		if (!Cube::parseMoves(in, moves)) {
+			std::cout << "Invalid moves: " << setupMoves << std::endl;
+			return 1;
 		}
+		MoveMacro(moves).apply(cube);
+	}
+
+	{
+		TRACE_SPAN("main", "output");
+		std::cout << "2x2x2 Cube:" << std::endl;
+		cube.printCube();
 	}
 
-	cube.saveInitState();
+	{
+		TRACE_SPAN("main", "validate");
+		ValidationResult validation = cube.validate();
+		if (!validation.isValid()) {
+			std::cout << "Unsolvable cube (error " << validation.error << "): " << validation.message << std::endl;
+			return 1;
+		}
 
-	std::cout << "2x2x2 Cube:" << std::endl;
-	cube.printCube();
+		// Relabel into the init color scheme with the DBL corner fixed, whatever way the cube is held
+		cube.normalizeOrientation();
+		cube.saveInitState();
+	}
 
-	cube.dfs();
+	// The dfs finishes from a table of the states within endgameDepth moves of solved
+	EndgameTable endgame;
+	if (endgameDepth > 0 && solver == "dfs") {
+		TRACE_SPAN("tables", "endgame table");
+		auto begin_time = std::chrono::steady_clock::now();
+		endgame.build(endgameDepth, options.metric, threads);
+		std::chrono::duration<double> buildTime = std::chrono::steady_clock::now() - begin_time;
+		std::cout << "Endgame table of " << endgame.size() << " states within " << endgameDepth << " moves (" << endgame.memoryBytes() << " bytes) built in " << buildTime.count() << " seconds.\n";
+		options.endgame = &endgame;
+	}
 
+	// A single dfs solve saves its progress with -checkpoint, and goes on from it with -resume
+	options.checkpoint = checkpointFile;
+	options.checkpointInterval = checkpointInterval;
+	options.resume = resume;
+
+	int exitCode = 0;
+	{
+		TRACE_SPAN("main", "solve");
+		const Cube222::Facelets start = cube.getFacelets();
+		std::vector<Rotation> solution;
+		if (solutionCache != nullptr && solutionCache->lookup(start, options.metric, solution)) {
+			std::cout << "Cached solution: ";
+			for (Rotation move : solution) {
+				std::cout << Cube::rotationToString(move) << " ";
+			}
+			std::cout << "\n";
+			cube.applySolution(solution);
+		}
+		else if (solver == "table") {
+			if (solveWithTable(cube, options.metric, solution) && solutionCache != nullptr) {
+				solutionCache->store(start, options.metric, solution);
+			}
+		}
+		else if (solver == "full") {
+			if (solveWithDistanceTable(cube, options.metric, threads, tableFile, solution) && solutionCache != nullptr) {
+				solutionCache->store(start, options.metric, solution);
+			}
+		}
+		else {
+			std::signal(SIGINT, onInterrupt);
+			SolveResult result = solver == "anytime" ? solveAnytime(cube, options) : cube.dfs(options);
+			std::signal(SIGINT, SIG_DFL);
+			if (stats == "json") {
+				std::cout << result.stats.toJson() << std::endl;
+			}
+			else if (stats == "text") {
+				std::cout << result.stats.nodes << " nodes in " << result.stats.seconds << " seconds (" << result.stats.nodesPerSecond() << " nodes/s), "
+					<< result.stats.pruneRate() * 100 << "% pruned, " << result.stats.cutoffRate() * 100 << "% cut off." << std::endl;
+			}
+#ifdef RUBIKS_ALLOC_AUDIT
+			std::cout << result.stats.allocations << " heap allocations inside the search." << std::endl;
+#endif
+			if (result.status != SOLVED) {
+				exitCode = 2;
+			}
+			else if (result.optimal && solutionCache != nullptr) {
+				solutionCache->store(start, options.metric, result.solution);
+			}
+		}
+	}
+
+	TRACE_SPAN("main", "output");
+	cube.simplifyRotations();
 	cube.printCube();
 
-	return 0;
+	// Whatever the solver reported, a cube left unsolved is a failure
+	if (exitCode == 0 && !cube.isSolved()) {
+		exitCode = 2;
+	}
+	return exitCode;
 };
\ No newline at end of file
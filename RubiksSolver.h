@@ -15,4 +15,17 @@
 #include <functional>
 #include <concepts>
 
-// TODO: Reference additional headers your program requires here.
+#include "Cube.h"
+#include "Symmetry.h"
+#include "TwoPhase.h"
+#include "Macro.h"
+#include "CubeBatch.h"
+#include "Scramble.h"
+#include "Perft.h"
+#include "Histogram.h"
+#include "Cache.h"
+#include "PerfectHash.h"
+#include "Endgame.h"
+#include "DistanceTable.h"
+#include "ExternalBfs.h"
+#include "AllocAudit.h"
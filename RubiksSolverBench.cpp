@@ -0,0 +1,700 @@
+﻿// RubiksSolverBench.cpp : Micro and macro benchmarks for the solver.
+//
+// Follows the Google Benchmark command line and JSON layout so results can be
+// compared with its tools, without depending on the library:
+//   --benchmark_filter=<regex>        run only the matching benchmarks
+//   --benchmark_format=console|json   format of the standard output
+//   --benchmark_out=<file>            also write the JSON report to a file
+
+#include "RubiksSolver.h"
+
+#include <random>
+#include <numeric>
+#include <regex>
+#include <fstream>
+#include <sstream>
+#include <ctime>
+#include <thread>
+#include <filesystem>
+#include <cstdlib>
+
+// Every heap allocation of the process is reported to AllocAudit, so a benchmark can report the
+// allocations its iterations make from AllocAudit::total(), and a search the ones in its node loops
+#include "AllocHooks.h"
+
+namespace {
+
+	volatile uint64_t sink;
+
+	/// <summary>
+	/// One benchmark run, in the shape of a Google Benchmark JSON entry
+	/// </summary>
+	struct BenchmarkResult {
+		std::string name;
+		uint64_t iterations = 0;
+		double realTime = 0;                        // ns per iteration
+		double cpuTime = 0;                         // ns per iteration
+		uint64_t allocations = 0;                   // Heap allocations over all iterations
+		std::map<std::string, double> counters;
+	};
+
+	std::vector<BenchmarkResult> results;
+	std::regex filter(".*");
+	bool consoleOutput = true;
+
+	/// <summary>
+	/// Run fn for iterations times and record the time per call. Macro benchmarks add their
+	/// own counters to the returned result.
+	/// </summary>
+	/// <returns>The result, or nullptr if the filter skipped the benchmark</returns>
+	template <typename Fn>
+	BenchmarkResult* runBenchmark(const std::string& name, uint64_t iterations, Fn fn) {
+		if (!std::regex_search(name, filter)) {
+			return nullptr;
+		}
+
+		const uint64_t allocationsBegin = AllocAudit::total();
+		const std::clock_t cpuBegin = std::clock();
+		auto begin = std::chrono::steady_clock::now();
+		uint64_t acc = 0;
+		for (uint64_t i = 0; i < iterations; ++i) {
+			acc += fn(i);
+		}
+		auto end = std::chrono::steady_clock::now();
+		const std::clock_t cpuEnd = std::clock();
+		sink = acc;
+		const uint64_t allocations = AllocAudit::total() - allocationsBegin;
+
+		BenchmarkResult result;
+		result.name = name;
+		result.iterations = iterations;
+		result.realTime = std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+		result.cpuTime = 1e9 * (cpuEnd - cpuBegin) / CLOCKS_PER_SEC / iterations;
+		result.allocations = allocations;
+		results.push_back(result);
+		return &results.back();
+	}
+
+	/// <summary>
+	/// Turn a total over all iterations into a rate per second of the benchmark's real time
+	/// </summary>
+	void setRate(BenchmarkResult* result, const std::string& counter, double total) {
+		if (result != nullptr) {
+			result->counters[counter] = total / (result->realTime * result->iterations * 1e-9);
+		}
+	}
+
+	/// <summary>
+	/// Heap allocations per unit of work (a copy, a search node) over all iterations
+	/// </summary>
+	void setAllocations(BenchmarkResult* result, const std::string& counter, double units) {
+		if (result != nullptr) {
+			result->counters[counter] = units > 0 ? result->allocations / units : 0;
+		}
+	}
+
+	/// <summary>
+	/// Allocations per node of a search benchmark, from the AllocAudit counts of its solves
+	/// </summary>
+	/// <returns>False if a node allocated</returns>
+	bool checkNodeAllocations(BenchmarkResult* result, uint64_t allocations, uint64_t nodes) {
+		if (result == nullptr) {
+			return true;
+		}
+		result->counters["allocs_per_node"] = nodes > 0 ? (double)allocations / nodes : 0;
+		if (allocations > 0) {
+			std::cerr << result->name << " allocates " << allocations << " times in its node loops" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	void printConsole(const BenchmarkResult& result) {
+		std::cout << std::left << std::setw(44) << result.name << std::right << std::fixed << std::setprecision(2)
+			<< std::setw(14) << result.realTime << " ns" << std::setw(14) << result.cpuTime << " ns" << std::setw(12) << result.iterations;
+		for (const auto& counter : result.counters) {
+			std::cout << " " << counter.first << "=" << std::setprecision(counter.second < 1000 ? 2 : 0) << counter.second;
+		}
+		std::cout << "\n";
+	}
+
+	std::string jsonString(const std::string& text) {
+		std::string quoted = "\"";
+		for (char c : text) {
+			if (c == '"' || c == '\\') {
+				quoted += '\\';
+			}
+			quoted += c;
+		}
+		return quoted + "\"";
+	}
+
+	void writeJson(std::ostream& out, const std::string& executable) {
+		char date[32];
+		const std::time_t now = std::time(nullptr);
+		std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+		out << std::setprecision(6) << std::defaultfloat;
+		out << "{\n  \"context\": {\n";
+		out << "    \"date\": " << jsonString(date) << ",\n";
+		out << "    \"executable\": " << jsonString(executable) << ",\n";
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+		out << "    \"library_build_type\": \"release\"\n";
+#else
+		out << "    \"library_build_type\": \"debug\"\n";
+#endif
+		out << "  },\n  \"benchmarks\": [\n";
+		for (size_t i = 0; i < results.size(); ++i) {
+			const BenchmarkResult& result = results[i];
+			out << "    {\n";
+			out << "      \"name\": " << jsonString(result.name) << ",\n";
+			out << "      \"run_name\": " << jsonString(result.name) << ",\n";
+			out << "      \"run_type\": \"iteration\",\n";
+			out << "      \"iterations\": " << result.iterations << ",\n";
+			out << "      \"real_time\": " << result.realTime << ",\n";
+			out << "      \"cpu_time\": " << result.cpuTime << ",\n";
+			for (const auto& counter : result.counters) {
+				out << "      " << jsonString(counter.first) << ": " << counter.second << ",\n";
+			}
+			out << "      \"time_unit\": \"ns\"\n";
+			out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+	}
+
+	/// <summary>
+	/// Textbook O(n^2) Lehmer ranking, the baseline for Lehmer::rankPermutation
+	/// </summary>
+	template <size_t N>
+	uint64_t naiveRankPermutation(const std::array<uint8_t, N>& perm) {
+		uint64_t rank = 0;
+		for (size_t i = 0; i < N; ++i) {
+			uint64_t smaller = 0;
+			for (size_t j = i + 1; j < N; ++j) {
+				if (perm[j] < perm[i]) {
+					++smaller;
+				}
+			}
+			rank += smaller * Lehmer::factorial((int)(N - 1 - i));
+		}
+		return rank;
+	}
+
+	template <size_t N>
+	std::vector<std::array<uint8_t, N>> randomPermutations(size_t count, std::mt19937_64& rng) {
+		std::vector<std::array<uint8_t, N>> perms(count);
+		for (auto& p : perms) {
+			std::iota(p.begin(), p.end(), (uint8_t)0);
+			std::shuffle(p.begin(), p.end(), rng);
+		}
+		return perms;
+	}
+
+	template <size_t N>
+	void benchmarkPermutation(const std::string& label, std::mt19937_64& rng) {
+		const size_t count = 4096;
+		const uint64_t iterations = 4'000'000;
+		auto perms = randomPermutations<N>(count, rng);
+		std::vector<uint64_t> ranks(count);
+		for (size_t i = 0; i < count; ++i) {
+			ranks[i] = Lehmer::rankPermutation(perms[i]);
+			std::array<uint8_t, N> back;
+			Lehmer::unrankPermutation(ranks[i], back);
+			if (ranks[i] != naiveRankPermutation(perms[i]) || back != perms[i]) {
+				std::cerr << "Lehmer round trip failed for " << label << std::endl;
+				std::exit(1);
+			}
+		}
+
+		runBenchmark("naiveRankPermutation<" + label + ">", iterations, [&](uint64_t i) {
+			return naiveRankPermutation(perms[i % count]);
+		});
+		runBenchmark("Lehmer::rankPermutation<" + label + ">", iterations, [&](uint64_t i) {
+			return Lehmer::rankPermutation(perms[i % count]);
+		});
+		runBenchmark("Lehmer::unrankPermutation<" + label + ">", iterations, [&](uint64_t i) {
+			std::array<uint8_t, N> p;
+			Lehmer::unrankPermutation(ranks[i % count], p);
+			return (uint64_t)p[0] + p[N - 1];
+		});
+	}
+
+	/// <summary>
+	/// Swallows the progress lines dfs prints while it is being timed
+	/// </summary>
+	class SilenceOutput {
+	public:
+		SilenceOutput() : _saved(std::cout.rdbuf(_null.rdbuf())) {
+		}
+
+		~SilenceOutput() {
+			std::cout.rdbuf(_saved);
+		}
+
+	private:
+		std::ostringstream _null;
+		std::streambuf* _saved;
+	};
+}
+
+int main(int argc, char* argv[]) {
+	std::string outFile;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg.rfind("--benchmark_filter=", 0) == 0) {
+			filter = std::regex(arg.substr(19));
+		}
+		else if (arg == "--benchmark_format=json") {
+			consoleOutput = false;
+		}
+		else if (arg.rfind("--benchmark_out=", 0) == 0) {
+			outFile = arg.substr(16);
+		}
+		else if (arg != "--benchmark_format=console") {
+			std::cerr << "Unknown option: " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	std::mt19937_64 rng(2024);
+
+	// Building blocks
+
+	benchmarkPermutation<7>("7", rng);
+	benchmarkPermutation<8>("8", rng);
+	benchmarkPermutation<12>("12", rng);
+
+	runBenchmark("Lehmer::rankOrientation<8>", 4'000'000, [](uint64_t i) {
+		std::array<uint8_t, 8> co;
+		Lehmer::unrankOrientation((uint32_t)(i % 2187), 3, co);
+		return (uint64_t)Lehmer::rankOrientation(co, 3);
+	});
+
+	// Cube operations, the rotations in ns per move
+
+	Cube222 cube;
+	cube.saveInitState();
+	for (int r = 0; r < Cube222::RotationCount; ++r) {
+		runBenchmark("Cube222::applyRotation/" + Cube::rotationToString((Rotation)r), 1'000'000, [&](uint64_t) {
+			cube.applyRotation((Rotation)r);
+			return (uint64_t)cube.getFacelet(0);
+		});
+		cube.reset();
+	}
+	// A copy on the heap, as the cubes were copied before the pool
+	BenchmarkResult* heap = runBenchmark("Cube222::Cube222(const Cube222&)/heap", 1'000'000, [&](uint64_t) {
+		auto clone = std::make_unique<Cube222>(cube);
+		return (uint64_t)clone->getColor(TOP, 0, 0);
+	});
+	setAllocations(heap, "allocs_per_copy", 1'000'000.0);
+	BenchmarkResult* pooled = runBenchmark("Cube222::copy", 1'000'000, [&](uint64_t) {
+		auto clone = cube.copy();
+		return (uint64_t)clone->getColor(TOP, 0, 0);
+	});
+	setAllocations(pooled, "allocs_per_copy", 1'000'000.0);
+	runBenchmark("Cube222::isSolved", 1'000'000, [&](uint64_t) {
+		return (uint64_t)cube.isSolved();
+	});
+	runBenchmark("Cube222::reset", 1'000'000, [&](uint64_t) {
+		cube.reset();
+		return (uint64_t)cube.getFacelet(0);
+	});
+
+	// The same operations on 32 cubes at once, against the facelet form one cube at a time
+
+	Cube222::Facelets single = Cube222().getFacelets();
+	BenchmarkResult* permute = runBenchmark("Cube222::permute", 1'000'000, [&](uint64_t i) {
+		single = Cube222::permute(single, Cube222::moveFacelets[i % 9]);
+		return (uint64_t)single[0];
+	});
+	setRate(permute, "cubes_per_second", 1'000'000.0);
+	CubeBatch batch;
+	BenchmarkResult* batchApply = runBenchmark("CubeBatch::apply", 1'000'000, [&](uint64_t i) {
+		batch.apply((Rotation)(i % 9));
+		return (uint64_t)batch.solvedMask();
+	});
+	setRate(batchApply, "cubes_per_second", 32'000'000.0);
+	BenchmarkResult* batchMasked = runBenchmark("CubeBatch::apply/masked", 1'000'000, [&](uint64_t i) {
+		batch.apply((Rotation)(i % 9), (uint32_t)(i * 2654435761u));
+		return (uint64_t)batch.solvedMask();
+	});
+	setRate(batchMasked, "cubes_per_second", 32'000'000.0);
+
+	// Solutions of 1024 scrambles of 14 moves checked in batches; every one must solve its cube
+	{
+		ScrambleGenerator sequences(7);
+		std::vector<Cube222::Facelets> scrambled;
+		std::vector<std::vector<Rotation>> undo;
+		for (int i = 0; i < 1024; ++i) {
+			std::vector<Rotation> moves = sequences.randomMoves(14);
+			Cube222::Facelets state = Cube222().getFacelets();
+			for (Rotation move : moves) {
+				state = Cube222::permute(state, Cube222::moveFacelets[move]);
+			}
+			std::vector<Rotation> inverse;
+			for (auto it = moves.rbegin(); it != moves.rend(); ++it) {
+				inverse.push_back(inverseRotation(*it));
+			}
+			scrambled.push_back(state);
+			undo.push_back(inverse);
+		}
+		size_t wrong = 0;
+		BenchmarkResult* check = runBenchmark("CubeBatch::checkSolutions/1024", 10, [&](uint64_t) {
+			wrong += CubeBatch::checkSolutions(scrambled, undo).size();
+			return (uint64_t)wrong;
+		});
+		if (wrong > 0) {
+			std::cerr << "CubeBatch::checkSolutions rejects " << wrong << " correct solutions" << std::endl;
+			return 1;
+		}
+		setRate(check, "cubes_per_second", 10 * 1024.0);
+		BenchmarkResult* scalar = runBenchmark("Cube222::permute/check/1024", 10, [&](uint64_t) {
+			const Cube222::Facelets solved = Cube222().getFacelets();
+			for (size_t i = 0; i < scrambled.size(); ++i) {
+				Cube222::Facelets state = scrambled[i];
+				for (Rotation move : undo[i]) {
+					state = Cube222::permute(state, Cube222::moveFacelets[move]);
+				}
+				wrong += state == solved ? 0 : 1;
+			}
+			return (uint64_t)wrong;
+		});
+		setRate(scalar, "cubes_per_second", 10 * 1024.0);
+
+		// One solution at a time: on a cube through applySolution, or composed and applied once
+		BenchmarkResult* applied = runBenchmark("Cube222::applySolution/14", 100'000, [&](uint64_t i) {
+			Cube222 solving;
+			solving.setFacelets(scrambled[i % scrambled.size()]);
+			solving.applySolution(undo[i % undo.size()]);
+			return (uint64_t)solving.isSolved();
+		});
+		setRate(applied, "solutions_per_second", 100'000.0);
+		uint64_t verified = 0;
+		BenchmarkResult* verify = runBenchmark("Cube222::verify/14", 1'000'000, [&](uint64_t i) {
+			verified += Cube222::verify(scrambled[i % scrambled.size()], undo[i % undo.size()]) ? 1 : 0;
+			return verified;
+		});
+		if (verified != 1'000'000 && verify != nullptr) {
+			std::cerr << "Cube222::verify rejects " << 1'000'000 - verified << " correct solutions" << std::endl;
+			return 1;
+		}
+		setRate(verify, "solutions_per_second", 1'000'000.0);
+	}
+
+	// A 20-move sequence applied move by move, compiled once, and looked up in a macro cache
+	{
+		ScrambleGenerator sequences(11);
+		const std::vector<Rotation> moves = sequences.randomMoves(20);
+		const MoveMacro macro(moves);
+		Cube222::Facelets stepped = Cube222().getFacelets();
+		Cube222::Facelets compiled = stepped;
+		runBenchmark("Cube222::permute/sequence/20", 1'000'000, [&](uint64_t) {
+			for (Rotation move : moves) {
+				stepped = Cube222::permute(stepped, Cube222::moveFacelets[move]);
+			}
+			return (uint64_t)stepped[0];
+		});
+		runBenchmark("MoveMacro::apply/20", 1'000'000, [&](uint64_t) {
+			compiled = macro.apply(compiled);
+			return (uint64_t)compiled[0];
+		});
+		if (stepped != compiled) {
+			std::cerr << "MoveMacro::apply differs from the moves applied one by one" << std::endl;
+			return 1;
+		}
+		runBenchmark("MoveMacro::compile/20", 1'000'000, [&](uint64_t) {
+			return (uint64_t)MoveMacro(moves).permutation()[0];
+		});
+		MacroCache macros;
+		runBenchmark("MacroCache::compile/hit/20", 1'000'000, [&](uint64_t) {
+			return (uint64_t)macros.compile(moves).permutation()[0];
+		});
+
+		// The sequence followed by its inverse cancels down to nothing
+		std::vector<Rotation> undone = moves;
+		for (auto it = moves.rbegin(); it != moves.rend(); ++it) {
+			undone.push_back(inverseRotation(*it));
+		}
+		size_t left = 0;
+		runBenchmark("Cube::simplifySolution/40", 1'000'000, [&](uint64_t) {
+			left += Cube::simplifySolution(undone).size();
+			return (uint64_t)left;
+		});
+		if (left > 0) {
+			std::cerr << "Cube::simplifySolution leaves moves of a sequence that cancels out" << std::endl;
+			return 1;
+		}
+	}
+
+	// Hashing: the perfect index of a state, and the symmetry reductions on top of it
+
+	runBenchmark("Cube222::decode", 1'000'000, [&](uint64_t i) {
+		cube.decode((uint32_t)((i * 2654435761u) % Cube222::StateCount));
+		return (uint64_t)cube.getFacelet(0);
+	});
+	std::vector<Cube222> cubes(256);
+	for (size_t i = 0; i < cubes.size(); ++i) {
+		cubes[i].decode((uint32_t)(rng() % Cube222::StateCount));
+	}
+	runBenchmark("Cube222::encode", 1'000'000, [&](uint64_t i) {
+		return (uint64_t)cubes[i % cubes.size()].encode();
+	});
+
+	std::vector<Cube222::Facelets> states(cubes.size());
+	for (size_t i = 0; i < cubes.size(); ++i) {
+		states[i] = cubes[i].getFacelets();
+	}
+	runBenchmark("Cube222::encodeFacelets", 1'000'000, [&](uint64_t i) {
+		return (uint64_t)Cube222::encodeFacelets(states[i % states.size()]);
+	});
+	runBenchmark("CubeSymmetry::representative", 100'000, [&](uint64_t i) {
+		int sym;
+		return (uint64_t)CubeSymmetry::instance().representative(states[i % states.size()], sym);
+	});
+
+	// Solvers on fixed sets of seeded scrambles, one set per scramble length
+
+	const size_t scrambleCount = 16;
+	ScrambleGenerator generator(2024);
+	std::vector<std::vector<Cube222::Facelets>> scrambles(15);
+	for (int length = 0; length < (int)scrambles.size(); ++length) {
+		for (size_t i = 0; i < scrambleCount; ++i) {
+			scrambles[length].push_back(generator.randomScramble(length));
+		}
+	}
+
+	// Repeat queries of solved scrambles, answered from the cache's state index
+	SolutionCache cache;
+	std::vector<Cube222::Facelets> repeats;
+	for (int length = 1; length < (int)scrambles.size(); ++length) {
+		for (const Cube222::Facelets& state : scrambles[length]) {
+			cache.store(state, QUARTER_TURN, TwoPhaseSolver::instance().solve(state, SolveOptions()).solution);
+			repeats.push_back(state);
+		}
+	}
+	runBenchmark("SolutionCache::lookup/repeat", 1'000'000, [&](uint64_t i) {
+		std::vector<Rotation> solution;
+		return (uint64_t)cache.lookup(repeats[i % repeats.size()], QUARTER_TURN, solution);
+	});
+
+	SymmetryTable table;
+	BenchmarkResult* build = runBenchmark("SymmetryTable::build", 1, [&](uint64_t) {
+		table.build();
+		return (uint64_t)table.classCount();
+	});
+	if (build != nullptr) {
+		build->counters["classes"] = (double)table.classCount();
+		build->counters["bytes"] = (double)table.memoryBytes();
+		for (int length = 1; length < (int)scrambles.size(); ++length) {
+			BenchmarkResult* result = runBenchmark("SymmetryTable::solve/depth:" + std::to_string(length), 10 * scrambleCount, [&](uint64_t i) {
+				std::vector<Rotation> solution;
+				table.solve(scrambles[length][i % scrambleCount], solution);
+				return (uint64_t)solution.size();
+			});
+			setRate(result, "solves_per_second", 10.0 * scrambleCount);
+		}
+	}
+
+	TwoPhaseSolver::instance();
+	runBenchmark("TwoPhaseSolver first solution", 10'000, [&](uint64_t i) {
+		// Stop the search at its first published solution
+		CancellationToken stop;
+		SolveOptions options;
+		options.cancel = &stop;
+		options.checkInterval = 1;
+		SolveResult result = TwoPhaseSolver::instance().solve(scrambles.back()[i % scrambleCount], options, [&](const SolveResult&) {
+			stop.cancel();
+		});
+		return (uint64_t)result.solution.size();
+	});
+	for (Metric metric : { QUARTER_TURN, HALF_TURN }) {
+		SolveOptions options;
+		options.metric = metric;
+		for (int length = 1; length < (int)scrambles.size(); ++length) {
+			uint64_t nodes = 0;
+			uint64_t allocations = 0;
+			BenchmarkResult* result = runBenchmark(std::string("TwoPhaseSolver::solve/") + (metric == HALF_TURN ? "htm" : "qtm") + "/depth:" + std::to_string(length), scrambleCount, [&](uint64_t i) {
+				SolveResult solved = TwoPhaseSolver::instance().solve(scrambles[length][i % scrambleCount], options);
+				nodes += solved.nodes;
+				allocations += solved.stats.allocations;
+				return (uint64_t)solved.solution.size();
+			});
+			setRate(result, "nodes_per_second", (double)nodes);
+			setRate(result, "solves_per_second", (double)scrambleCount);
+			if (!checkNodeAllocations(result, allocations, nodes)) {
+				return 1;
+			}
+		}
+	}
+
+	// Full distance table on 1, 2, 4, ... threads; every build must match the single-threaded one
+	std::unique_ptr<DistanceTable> reference;
+	auto distanceTable = std::make_unique<DistanceTable>();
+	const int maxThreads = std::max(2, (int)std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= maxThreads; threads *= 2) {
+		BenchmarkResult* result = runBenchmark("DistanceTable::build/threads:" + std::to_string(threads), 1, [&](uint64_t) {
+			distanceTable->build(QUARTER_TURN, threads);
+			return (uint64_t)distanceTable->levels().size();
+		});
+		if (result != nullptr) {
+			setRate(result, "states_per_second", (double)DistanceTable::Size);
+			if (reference == nullptr) {
+				reference = std::make_unique<DistanceTable>();
+				reference->build();
+			}
+			if (!distanceTable->sameAs(*reference)) {
+				std::cerr << "DistanceTable built on " << threads << " threads differs from the single-threaded build" << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	// External-memory search under a 4 MB cap, which takes several runs per layer; the file must load as the same table
+	{
+		const std::filesystem::path directory = std::filesystem::temp_directory_path() / "RubiksSolver_bench_bfs";
+		const std::string tablePath = (directory / "table.bin").string();
+		ExternalBfs search(directory.string(), 4 << 20);
+		BenchmarkResult* result = runBenchmark("ExternalBfs::build/memory:4MB", 1, [&](uint64_t) {
+			return (uint64_t)search.build(QUARTER_TURN, tablePath);
+		});
+		if (result != nullptr) {
+			setRate(result, "states_per_second", (double)DistanceTable::Size);
+			if (reference == nullptr) {
+				reference = std::make_unique<DistanceTable>();
+				reference->build();
+			}
+			if (!distanceTable->load(tablePath, QUARTER_TURN) || !distanceTable->sameAs(*reference)) {
+				std::cerr << "ExternalBfs table differs from the in-memory build" << std::endl;
+				return 1;
+			}
+		}
+		std::error_code error;
+		std::filesystem::remove_all(directory, error);
+	}
+
+	// Perft: the full state space, level by level; a wrong count fails the run
+	for (Metric metric : { QUARTER_TURN, HALF_TURN }) {
+		std::vector<Perft::Level> levels;
+		BenchmarkResult* result = runBenchmark(std::string("Perft/") + (metric == HALF_TURN ? "htm" : "qtm"), 1, [&](uint64_t) {
+			levels = Perft::run(20, metric);
+			return (uint64_t)levels.size();
+		});
+		if (result == nullptr) {
+			continue;
+		}
+		if (Perft::check(levels, metric) >= 0) {
+			std::cerr << "Perft failed at depth " << Perft::check(levels, metric) << std::endl;
+			return 1;
+		}
+		uint64_t nodes = 0;
+		for (const Perft::Level& level : levels) {
+			nodes += level.nodes;
+		}
+		setRate(result, "nodes_per_second", (double)nodes);
+	}
+
+	// The plain dfs grows fivefold per move, so only the short scrambles
+	for (int length = 1; length <= 6; ++length) {
+		uint64_t nodes = 0;
+		uint64_t allocations = 0;
+		BenchmarkResult* result = runBenchmark("Cube222::dfs/depth:" + std::to_string(length), scrambleCount, [&](uint64_t i) {
+			Cube222 scrambled;
+			scrambled.setFacelets(scrambles[length][i % scrambleCount]);
+			SilenceOutput silence;
+			SolveResult solved = scrambled.dfs();
+			nodes += solved.nodes;
+			allocations += solved.stats.allocations;
+			return (uint64_t)solved.solution.size();
+		});
+		setRate(result, "nodes_per_second", (double)nodes);
+		setRate(result, "solves_per_second", (double)scrambleCount);
+		if (!checkNodeAllocations(result, allocations, nodes)) {
+			return 1;
+		}
+	}
+
+	// The dfs with an endgame table finishes the last plies from the table instead of searching them
+	EndgameTable endgame;
+	BenchmarkResult* endgameBuild = runBenchmark("EndgameTable::build/depth:8", 1, [&](uint64_t) {
+		endgame.build(8);
+		return (uint64_t)endgame.size();
+	});
+	if (endgameBuild != nullptr) {
+		endgameBuild->counters["states"] = (double)endgame.size();
+		endgameBuild->counters["bytes"] = (double)endgame.memoryBytes();
+	}
+	else {
+		endgame.build(8);
+	}
+	SolveOptions endgameOptions;
+	endgameOptions.endgame = &endgame;
+	for (int length = 1; length <= 12; ++length) {
+		uint64_t nodes = 0;
+		uint64_t allocations = 0;
+		BenchmarkResult* result = runBenchmark("Cube222::dfs+endgame/depth:" + std::to_string(length), scrambleCount, [&](uint64_t i) {
+			Cube222 scrambled;
+			scrambled.setFacelets(scrambles[length][i % scrambleCount]);
+			SilenceOutput silence;
+			SolveResult solved = scrambled.dfs(endgameOptions);
+			nodes += solved.nodes;
+			allocations += solved.stats.allocations;
+			return (uint64_t)solved.solution.size();
+		});
+		setRate(result, "nodes_per_second", (double)nodes);
+		setRate(result, "solves_per_second", (double)scrambleCount);
+		if (!checkNodeAllocations(result, allocations, nodes)) {
+			return 1;
+		}
+	}
+
+	// Minimal perfect hash over a million state indices spread over the whole range; every key must get its own slot
+	{
+		std::vector<uint64_t> keys;
+		for (uint32_t index = 0; index < Cube222::StateCount && keys.size() < 1000000; index += 83) {
+			keys.push_back(index);
+		}
+		PerfectHash hash;
+		for (int threads : { 1, 2, 4 }) {
+			BenchmarkResult* result = runBenchmark("PerfectHash::build/threads:" + std::to_string(threads), 1, [&](uint64_t) {
+				hash.build(keys, 1.0, threads);
+				return (uint64_t)hash.size();
+			});
+			if (result != nullptr) {
+				setRate(result, "keys_per_second", (double)keys.size());
+				result->counters["bits_per_key"] = hash.bitsPerKey();
+			}
+		}
+		hash.build(keys);
+		std::vector<bool> taken(keys.size());
+		for (uint64_t key : keys) {
+			const uint64_t slot = hash.lookup(key);
+			if (slot >= keys.size() || taken[slot]) {
+				std::cerr << "PerfectHash gives key " << key << " slot " << slot << ", not a free one" << std::endl;
+				return 1;
+			}
+			taken[slot] = true;
+		}
+		BenchmarkResult* lookup = runBenchmark("PerfectHash::lookup", keys.size(), [&](uint64_t i) {
+			return hash.lookup(keys[(i * 7919) % keys.size()]);
+		});
+		setRate(lookup, "lookups_per_second", (double)keys.size());
+	}
+
+	if (consoleOutput) {
+		std::cout << std::left << std::setw(44) << "Benchmark" << std::right << std::setw(17) << "Time" << std::setw(17) << "CPU" << std::setw(12) << "Iterations" << "\n";
+		std::cout << std::string(90, '-') << "\n";
+		for (const BenchmarkResult& result : results) {
+			printConsole(result);
+		}
+	}
+	else {
+		writeJson(std::cout, argv[0]);
+	}
+	if (!outFile.empty()) {
+		std::ofstream out(outFile);
+		writeJson(out, argv[0]);
+	}
+
+	return 0;
+}
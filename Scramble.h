@@ -0,0 +1,187 @@
+﻿// Scramble.h : Seeded scrambles and workload corpora for Cube222
+//
+// Benchmarks, stress runs and capacity planning need the same inputs on every
+// machine and every release. The generator draws from a fixed-seed
+// std::mt19937_64, whose output sequence the standard pins down exactly, and
+// writes states in the command line's face-string format, one cube per line:
+//   -ft YYYY -ff BBBB -fr RRRR -fb WWWW -fbk GGGG -fl OOOO
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <string>
+#include <random>
+#include <sstream>
+#include <algorithm>
+
+#include "Cube.h"
+#include "CubeBatch.h"
+
+class ScrambleGenerator {
+public:
+	using Facelets = Cube222::Facelets;
+
+	ScrambleGenerator(uint64_t seed = 1) : _rng(seed) {
+	}
+
+	/// <summary>
+	/// Random move sequence with the DBL corner fixed. No move undoes the one before it, and in
+	/// the half turn metric no face turns twice in a row.
+	/// </summary>
+	/// <param name="length">Number of moves</param>
+	/// <param name="metric">Quarter turns only, or quarter and half turns</param>
+	/// <returns>Moves</returns>
+	std::vector<Rotation> randomMoves(int length, Metric metric = QUARTER_TURN) {
+		static const std::vector<Rotation> quarterTurns = { U, R, F, UI, RI, FI };
+		static const std::vector<Rotation> faceTurns = { U, R, F, UI, RI, FI, U2, R2, F2 };
+		const std::vector<Rotation>& moves = metric == HALF_TURN ? faceTurns : quarterTurns;
+
+		std::vector<Rotation> sequence;
+		for (int m = 0; m < length; ++m) {
+			Rotation move;
+			do {
+				move = moves[_rng() % moves.size()];
+			} while (m > 0 && (move == inverseRotation(sequence.back()) || (metric == HALF_TURN && rotationFace(move) == rotationFace(sequence.back()))));
+			sequence.push_back(move);
+		}
+		return sequence;
+	}
+
+	/// <summary>
+	/// State reached by a random move sequence from the init state
+	/// </summary>
+	Facelets randomScramble(int length, Metric metric = QUARTER_TURN) {
+		return MoveMacro(randomMoves(length, metric)).apply(Cube222().getFacelets());
+	}
+
+	/// <summary>
+	/// States reached by count random move sequences, the same states as count calls to
+	/// randomScramble, moved CubeBatch::Lanes at a time
+	/// </summary>
+	std::vector<Facelets> randomScrambles(int count, int length, Metric metric = QUARTER_TURN) {
+		std::vector<Facelets> states;
+		for (int first = 0; first < count; first += CubeBatch::Lanes) {
+			const int lanes = std::min(CubeBatch::Lanes, count - first);
+			std::vector<std::vector<Rotation>> sequences;
+			for (int l = 0; l < lanes; ++l) {
+				sequences.push_back(randomMoves(length, metric));
+			}
+			CubeBatch batch;
+			batch.applyEach(sequences.data(), lanes);
+			for (int l = 0; l < lanes; ++l) {
+				states.push_back(batch.get(l));
+			}
+		}
+		return states;
+	}
+
+	/// <summary>
+	/// Uniformly random state with the DBL corner fixed: a random rank of the permutation of the
+	/// other seven corners and of six of their twists (the seventh is implied), unranked.
+	/// The index is taken modulo the state count rather than through uniform_int_distribution,
+	/// whose output differs between standard libraries; the bias is below 1e-12.
+	/// </summary>
+	Facelets randomState() {
+		static constexpr int FreeCorners = Cube222::CornerCount - 1;
+		static constexpr std::array<uint8_t, FreeCorners> freeCorners = { 0, 1, 2, 3, 4, 5, 7 };
+		const uint64_t permutationCount = Lehmer::factorial(FreeCorners);
+		const uint32_t twistCount = (uint32_t)Lehmer::power(3, FreeCorners - 1);
+		const uint64_t index = _rng() % (permutationCount * twistCount);
+
+		std::array<uint8_t, FreeCorners> perm;
+		std::array<uint8_t, FreeCorners> twist;
+		Lehmer::unrankPermutation(index / twistCount, perm);
+		Lehmer::unrankOrientation((uint32_t)(index % twistCount), 3, twist);
+
+		std::array<uint8_t, Cube222::CornerCount> cp;
+		std::array<uint8_t, Cube222::CornerCount> co;
+		cp[6] = 6;
+		co[6] = 0;
+		for (int i = 0; i < FreeCorners; ++i) {
+			cp[freeCorners[i]] = freeCorners[perm[i]];
+			co[freeCorners[i]] = twist[i];
+		}
+		Cube222 cube;
+		cube.setCorners(cp, co);
+		return cube.getFacelets();
+	}
+
+	/// <summary>
+	/// Corpus of count states, one face string per line after a header comment
+	/// </summary>
+	/// <param name="count">Number of states</param>
+	/// <param name="length">Scramble length, 0 for uniformly random states</param>
+	/// <param name="metric">Moves used by the scrambles</param>
+	/// <returns>Corpus text</returns>
+	std::string corpus(int count, int length, Metric metric = QUARTER_TURN) {
+		std::ostringstream out;
+		out << "# " << count << (length > 0 ? " scrambles of " + std::to_string(length) + (metric == HALF_TURN ? " face turns" : " quarter turns") : " uniformly random states") << "\n";
+		if (length > 0) {
+			for (const Facelets& state : randomScrambles(count, length, metric)) {
+				out << toFaceString(state) << "\n";
+			}
+		}
+		else {
+			for (int i = 0; i < count; ++i) {
+				out << toFaceString(randomState()) << "\n";
+			}
+		}
+		return out.str();
+	}
+
+	/// <summary>
+	/// Face-string form of a state, the command line arguments that set it up
+	/// </summary>
+	static std::string toFaceString(const Facelets& facelets) {
+		std::string text;
+		for (const auto& tag : faceTags) {
+			text += std::string(text.empty() ? "" : " ") + tag.second + " ";
+			for (int i = 0; i < 4; ++i) {
+				text += colorChar((Color)facelets[tag.first * 4 + i]);
+			}
+		}
+		return text;
+	}
+
+	/// <summary>
+	/// Read a face-string line back. Unknown color letters become UNDEFINED, for validate to report.
+	/// </summary>
+	/// <param name="line">Line of a corpus</param>
+	/// <param name="facelets">State, faces missing from the line keep their init state colors</param>
+	/// <returns>False for blank lines, comments and unknown face tags</returns>
+	static bool parseFaceString(const std::string& line, Facelets& facelets) {
+		std::istringstream in(line);
+		std::string tag;
+		std::string colors;
+		facelets = Cube222().getFacelets();
+		bool any = false;
+		while (in >> tag) {
+			if (tag[0] == '#' || !(in >> colors) || tagToFace.count(tag) == 0 || colors.size() != 4) {
+				return false;
+			}
+			const int face = tagToFace[tag];
+			for (int i = 0; i < 4; ++i) {
+				facelets[face * 4 + i] = (uint8_t)(charToColor.count(colors[i]) > 0 ? charToColor[colors[i]] : UNDEFINED);
+			}
+			any = true;
+		}
+		return any;
+	}
+
+private:
+	std::mt19937_64 _rng;
+
+	static constexpr std::array<std::pair<Faces, const char*>, 6> faceTags = { {
+		{ TOP, "-ft" }, { FRONT, "-ff" }, { RIGHT, "-fr" }, { BOTTOM, "-fb" }, { BACK, "-fbk" }, { LEFT, "-fl" }
+	} };
+
+	static char colorChar(Color color) {
+		for (const auto& entry : charToColor) {
+			if (entry.second == color) {
+				return entry.first;
+			}
+		}
+		return '?';
+	}
+};
@@ -0,0 +1,291 @@
+﻿// Symmetry.h : The 48 symmetries of the cube and a symmetry-reduced distance table for Cube222
+//
+// Two states that differ by a whole-cube rotation or reflection need the same
+// number of moves, so one table entry per symmetry class is enough. Every
+// state is mapped to the smallest encoding among its 48 conjugates; that class
+// representative is the table key, and moves found for it are translated back
+// through the conjugating symmetry.
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <unordered_map>
+
+#include "Cube.h"
+
+class CubeSymmetry {
+public:
+	static constexpr int SymmetryCount = 48;
+	using Facelets = Cube222::Facelets;
+
+	/// <summary>
+	/// The shared symmetry tables
+	/// </summary>
+	static const CubeSymmetry& instance() {
+		static const CubeSymmetry symmetry;
+		return symmetry;
+	}
+
+	/// <summary>
+	/// Facelet permutation of a symmetry (moveFacelets form), symmetry 0 is the identity
+	/// </summary>
+	const Facelets& symmetry(int s) const {
+		return _symmetries[s];
+	}
+
+	/// <summary>
+	/// The move that has the same effect in the frame of symmetry s as move r has in the original frame
+	/// </summary>
+	Rotation toSymmetryFrame(int s, Rotation r) const {
+		return (Rotation)_toFrame[s][r];
+	}
+
+	/// <summary>
+	/// Inverse of toSymmetryFrame: translate a move found in the frame of symmetry s back to the original frame
+	/// </summary>
+	Rotation fromSymmetryFrame(int s, Rotation r) const {
+		return (Rotation)_fromFrame[s][r];
+	}
+
+	/// <summary>
+	/// Conjugate a state by a symmetry: move the stickers, then relabel the colors so that
+	/// the DBL corner (never moved by U, R and F) reads WHITE, GREEN, ORANGE again
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme</param>
+	/// <param name="s">Symmetry</param>
+	/// <returns>Conjugated state</returns>
+	Facelets conjugate(const Facelets& facelets, int s) const {
+		return relabelToFixedCorner(Cube222::permute(facelets, _symmetries[s]));
+	}
+
+	/// <summary>
+	/// Whether symmetry s is a proper rotation (the other 24 include a reflection)
+	/// </summary>
+	bool isRotation(int s) const {
+		return _isRotation[s];
+	}
+
+	/// <summary>
+	/// Class representative: the smallest encoding among the 48 conjugates
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme</param>
+	/// <param name="sym">Symmetry that maps the state onto its representative</param>
+	/// <returns>Encoding of the representative</returns>
+	uint32_t representative(const Facelets& facelets, int& sym) const {
+		uint32_t best = Cube222::InvalidState;
+		sym = 0;
+		for (int s = 0; s < SymmetryCount; ++s) {
+			const uint32_t index = Cube222::encodeFacelets(conjugate(facelets, s));
+			if (index < best) {
+				best = index;
+				sym = s;
+			}
+		}
+		return best;
+	}
+
+private:
+	std::array<Facelets, SymmetryCount> _symmetries;
+	std::array<bool, SymmetryCount> _isRotation;
+	std::array<std::array<uint8_t, Cube222::RotationCount>, SymmetryCount> _toFrame;
+	std::array<std::array<uint8_t, Cube222::RotationCount>, SymmetryCount> _fromFrame;
+
+	/// <summary>
+	/// Generate the group from the whole-cube rotations x and y and the left-right mirror
+	/// </summary>
+	CubeSymmetry() {
+		TRACE_SPAN("tables", "symmetries");
+		const Facelets x = compose(Cube222::moveFacelets[R], Cube222::moveFacelets[LI]);
+		const Facelets y = compose(Cube222::moveFacelets[U], Cube222::moveFacelets[DI]);
+		const Facelets mirror = {
+			1, 0, 3, 2, 5, 4, 7, 6, 21, 20, 23, 22,
+			13, 12, 15, 14, 17, 16, 19, 18, 9, 8, 11, 10
+		};
+
+		Facelets identity;
+		for (int i = 0; i < Cube222::FaceletCount; ++i) {
+			identity[i] = (uint8_t)i;
+		}
+
+		std::vector<Facelets> group = { identity };
+		std::vector<bool> rotation = { true };
+		for (size_t next = 0; next < group.size(); ++next) {
+			for (const Facelets* generator : { &x, &y, &mirror }) {
+				const Facelets candidate = compose(group[next], *generator);
+				if (std::find(group.begin(), group.end(), candidate) == group.end()) {
+					group.push_back(candidate);
+					rotation.push_back(rotation[next] != (generator == &mirror));
+				}
+			}
+		}
+		std::copy(group.begin(), group.end(), _symmetries.begin());
+		std::copy(rotation.begin(), rotation.end(), _isRotation.begin());
+
+		for (int s = 0; s < SymmetryCount; ++s) {
+			for (int r = 0; r < Cube222::RotationCount; ++r) {
+				// Find n with S(X * r) == S(X) * n for every state X
+				const Facelets lhs = compose(Cube222::moveFacelets[r], _symmetries[s]);
+				for (int n = 0; n < Cube222::RotationCount; ++n) {
+					if (compose(_symmetries[s], Cube222::moveFacelets[n]) == lhs) {
+						_toFrame[s][r] = (uint8_t)n;
+						_fromFrame[s][n] = (uint8_t)r;
+					}
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// Permutation that applies first, then second
+	/// </summary>
+	static Facelets compose(const Facelets& first, const Facelets& second) {
+		Facelets result;
+		for (int i = 0; i < Cube222::FaceletCount; ++i) {
+			result[i] = first[second[i]];
+		}
+		return result;
+	}
+
+	/// <summary>
+	/// Relabel colors so the DBL corner shows its init state colors, keeping the init scheme's opposite pairs
+	/// </summary>
+	static Facelets relabelToFixedCorner(const Facelets& facelets) {
+		const auto& dbl = Cube222::cornerFacelets[6];
+		for (int k = 0; k < 3; ++k) {
+			if (facelets[dbl[k]] >= UNDEFINED) {
+				return facelets;
+			}
+		}
+		return Cube222::relabel(facelets, Cube222::schemeFromFixedCorner(facelets, Cube222::initOppositeColors));
+	}
+};
+
+class SymmetryTable {
+public:
+	using Facelets = Cube222::Facelets;
+
+	/// <summary>
+	/// Breadth first search from the solved state over class representatives, using the
+	/// turns that keep the DBL corner in place. Each class stores its distance and a move
+	/// (in the representative's frame) that leads one step closer.
+	/// </summary>
+	/// <param name="metric">Quarter turns only, or quarter and half turns</param>
+	void build(Metric metric = QUARTER_TURN) {
+		TRACE_SPAN("tables", "distance table");
+		static const std::vector<Rotation> quarterTurns = { U, UI, R, RI, F, FI };
+		static const std::vector<Rotation> faceTurns = { U, UI, U2, R, RI, R2, F, FI, F2 };
+		const std::vector<Rotation>& moves = metric == HALF_TURN ? faceTurns : quarterTurns;
+		const CubeSymmetry& symmetry = CubeSymmetry::instance();
+		_metric = metric;
+
+		Cube222 solved;
+		std::unordered_map<uint32_t, uint16_t> entries;
+		std::vector<Facelets> frontier = { solved.getFacelets() };
+		entries[Cube222::encodeFacelets(frontier[0])] = pack(0, U);
+
+		for (int depth = 0; !frontier.empty(); ++depth) {
+			std::vector<Facelets> next;
+			for (const Facelets& state : frontier) {
+				for (Rotation move : moves) {
+					const Facelets child = Cube222::permute(state, Cube222::moveFacelets[move]);
+					int sym;
+					const uint32_t rep = symmetry.representative(child, sym);
+					if (entries.count(rep) == 0) {
+						// Undoing the move from the child leads back to depth
+						const Rotation back = symmetry.toSymmetryFrame(sym, inverseRotation(move));
+						entries[rep] = pack(depth + 1, back);
+						next.push_back(symmetry.conjugate(child, sym));
+					}
+				}
+			}
+			frontier.swap(next);
+		}
+
+		_representatives.clear();
+		_representatives.reserve(entries.size());
+		for (const auto& entry : entries) {
+			_representatives.push_back(entry.first);
+		}
+		std::sort(_representatives.begin(), _representatives.end());
+		_entries.resize(_representatives.size());
+		for (size_t i = 0; i < _representatives.size(); ++i) {
+			_entries[i] = entries[_representatives[i]];
+		}
+	}
+
+	/// <summary>
+	/// Number of symmetry classes stored
+	/// </summary>
+	size_t classCount() const {
+		return _representatives.size();
+	}
+
+	/// <summary>
+	/// Table memory in bytes
+	/// </summary>
+	size_t memoryBytes() const {
+		return _representatives.size() * sizeof(uint32_t) + _entries.size() * sizeof(uint16_t);
+	}
+
+	/// <summary>
+	/// Metric the table was built for
+	/// </summary>
+	Metric metric() const {
+		return _metric;
+	}
+
+	/// <summary>
+	/// Optimal distance of a state in the table's metric
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme</param>
+	/// <returns>Distance to solved, -1 if the state is not in the table</returns>
+	int distance(const Facelets& facelets) const {
+		int sym;
+		const int slot = find(CubeSymmetry::instance().representative(facelets, sym));
+		return slot < 0 ? -1 : _entries[slot] >> 8;
+	}
+
+	/// <summary>
+	/// Optimal solution by walking down the table: look up the class representative,
+	/// take its stored move and translate it back through the conjugating symmetry
+	/// </summary>
+	/// <param name="facelets">State in the init state color scheme</param>
+	/// <param name="solution">Moves in the frame of the given state</param>
+	/// <returns>False if the state is not in the table</returns>
+	bool solve(Facelets facelets, std::vector<Rotation>& solution) const {
+		const CubeSymmetry& symmetry = CubeSymmetry::instance();
+		solution.clear();
+		while (true) {
+			int sym;
+			const int slot = find(symmetry.representative(facelets, sym));
+			if (slot < 0) {
+				return false;
+			}
+			if ((_entries[slot] >> 8) == 0) {
+				return true;
+			}
+			const Rotation move = symmetry.fromSymmetryFrame(sym, (Rotation)(_entries[slot] & 0xFF));
+			facelets = Cube222::permute(facelets, Cube222::moveFacelets[move]);
+			solution.push_back(move);
+		}
+	}
+
+private:
+	std::vector<uint32_t> _representatives;
+	std::vector<uint16_t> _entries;
+	Metric _metric = QUARTER_TURN;
+
+	static uint16_t pack(int depth, Rotation move) {
+		return (uint16_t)((depth << 8) | move);
+	}
+
+	int find(uint32_t rep) const {
+		auto it = std::lower_bound(_representatives.begin(), _representatives.end(), rep);
+		if (it == _representatives.end() || *it != rep) {
+			return -1;
+		}
+		return (int)(it - _representatives.begin());
+	}
+};
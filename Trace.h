@@ -0,0 +1,191 @@
+﻿// Trace.h : Trace spans around the phases of a solve, written as Chrome trace events
+//
+// Built with RUBIKS_TRACE defined (cmake -DRUBIKS_TRACE=ON), TRACE_SPAN marks a
+// scope as a complete event and the command line writes every span to a JSON
+// file that chrome://tracing or ui.perfetto.dev open. Each thread records into
+// its own buffer without locking; the buffers are merged when the file is
+// written. Spans are only kept while a TraceSession is open, so benchmarks of a
+// traced build do not pile them up. Without RUBIKS_TRACE the macros expand to nothing.
+
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#ifdef RUBIKS_TRACE
+
+class Tracer {
+public:
+	/// <summary>
+	/// One complete ("X") event
+	/// </summary>
+	struct Event {
+		const char* category;
+		const char* name;
+		int64_t begin;                          // Nanoseconds since the tracer started
+		int64_t end;
+		int64_t value;                          // Argument shown with the span, when hasValue
+		bool hasValue;
+	};
+
+	static Tracer& instance() {
+		static Tracer tracer;
+		return tracer;
+	}
+
+	int64_t now() const {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _origin).count();
+	}
+
+	bool active() const {
+		return _active.load(std::memory_order_relaxed);
+	}
+
+	void setActive(bool active) {
+		_active.store(active, std::memory_order_relaxed);
+	}
+
+	/// <summary>
+	/// Append an event to the calling thread's buffer
+	/// </summary>
+	void record(const Event& event) {
+		if (!active()) {
+			return;
+		}
+		thread_local Buffer* buffer = registerThread();
+		buffer->events.push_back(event);
+	}
+
+	/// <summary>
+	/// Write every recorded span in the Chrome trace event format
+	/// </summary>
+	/// <param name="path">Output file</param>
+	/// <returns>False if the file could not be written</returns>
+	bool write(const std::string& path) {
+		std::ofstream out(path);
+		if (!out) {
+			std::cerr << "Cannot write trace file " << path << std::endl;
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		bool first = true;
+		for (const auto& buffer : _buffers) {
+			for (const Event& event : buffer->events) {
+				out << (first ? "\n" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->thread
+					<< ",\"cat\":\"" << event.category << "\",\"name\":\"" << event.name
+					<< "\",\"ts\":" << event.begin / 1000.0 << ",\"dur\":" << (event.end - event.begin) / 1000.0;
+				if (event.hasValue) {
+					out << ",\"args\":{\"value\":" << event.value << "}";
+				}
+				out << "}";
+				first = false;
+			}
+		}
+		out << "\n]}\n";
+		return true;
+	}
+
+private:
+	struct Buffer {
+		int thread;
+		std::vector<Event> events;
+	};
+
+	std::chrono::steady_clock::time_point _origin = std::chrono::steady_clock::now();
+	std::atomic<bool> _active = false;
+	std::mutex _mutex;
+	std::vector<std::unique_ptr<Buffer>> _buffers;
+
+	Tracer() = default;
+
+	Buffer* registerThread() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_buffers.push_back(std::make_unique<Buffer>());
+		_buffers.back()->thread = (int)_buffers.size();
+		_buffers.back()->events.reserve(1024);
+		return _buffers.back().get();
+	}
+};
+
+/// <summary>
+/// Records its scope as a span
+/// </summary>
+class TraceSpan {
+public:
+	TraceSpan(const char* category, const char* name) : _event{ category, name, Tracer::instance().now(), 0, 0, false } {
+	}
+
+	TraceSpan(const char* category, const char* name, int64_t value) : _event{ category, name, Tracer::instance().now(), 0, value, true } {
+	}
+
+	~TraceSpan() {
+		_event.end = Tracer::instance().now();
+		Tracer::instance().record(_event);
+	}
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	Tracer::Event _event;
+};
+
+/// <summary>
+/// Keeps the spans of its lifetime and writes them to the trace file at its end. Spans are
+/// recorded from construction, so that the ones before the command line names the file are
+/// kept; opening no file stops the recording and nothing is written.
+/// </summary>
+class TraceSession {
+public:
+	TraceSession() {
+		Tracer::instance().setActive(true);
+	}
+
+	void open(const std::string& path) {
+		_path = path;
+		if (_path.empty()) {
+			Tracer::instance().setActive(false);
+		}
+	}
+
+	~TraceSession() {
+		Tracer::instance().setActive(false);
+		if (!_path.empty() && Tracer::instance().write(_path)) {
+			std::cerr << "Trace written to " << _path << std::endl;
+		}
+	}
+
+private:
+	std::string _path;                      // Empty: no trace file
+};
+
+#define TRACE_SPAN(category, name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, name)
+#define TRACE_SPAN_VALUE(category, name, value) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(category, name, value)
+
+#else
+
+class TraceSession {
+public:
+	void open(const std::string& path) {
+		if (!path.empty()) {
+			std::cerr << "Tracing is not compiled in, configure with -DRUBIKS_TRACE=ON." << std::endl;
+		}
+	}
+};
+
+#define TRACE_SPAN(category, name) ((void)0)
+#define TRACE_SPAN_VALUE(category, name, value) ((void)0)
+
+#endif
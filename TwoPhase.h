@@ -0,0 +1,366 @@
+﻿// TwoPhase.h : Anytime two-phase solver for Cube222
+//
+// Phase 1 twists every corner so its U/D sticker faces up or down, using U, R
+// and F turns. Phase 2 then solves the permutation with the moves that keep
+// the twist solved: U, UI, U2, R2 and F2. Both phases are small: the tables
+// are indexed by the twist of the eight corners (2187 = 3^7, the last twist
+// follows from the others) and by their permutation (40320 = 8!), and with the
+// DBL corner fixed only 729 twists and 5040 permutations are reached. A first,
+// usually non-optimal, solution is found in well under a millisecond. The
+// search then keeps trying longer phase 1 sequences with a tighter total bound
+// and publishes every shorter solution it finds. Once phase 1 reaches the length of
+// the best solution, that solution is proven optimal.
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <functional>
+
+#include "Cube.h"
+
+class TwoPhaseSolver {
+public:
+	using Facelets = Cube222::Facelets;
+
+	/// <summary>
+	/// Called with every solution shorter than the ones before it
+	/// </summary>
+	using ImprovementCallback = std::function<void(const SolveResult&)>;
+
+	/// <summary>
+	/// The shared move and pruning tables
+	/// </summary>
+	static const TwoPhaseSolver& instance() {
+		static const TwoPhaseSolver solver;
+		return solver;
+	}
+
+	/// <summary>
+	/// Solve, publishing each improvement. Runs until the best solution is proven optimal or a
+	/// budget of the options runs out; a caller that needs an answer right away runs this on a
+	/// worker thread and takes the first published solution. options.maxDepth, if set, bounds
+	/// the solution length and options.metric how it is counted.
+	/// </summary>
+	/// <param name="facelets">Valid state in the init state color scheme with the DBL corner fixed</param>
+	/// <param name="options">Search budgets</param>
+	/// <param name="onImproved">Receives each shorter solution, may be empty</param>
+	/// <returns>The best solution; status is SOLVED once one was found, optimal once it is proven,
+	/// INVALID_STATE at once for a state that is not valid and normalized</returns>
+	SolveResult solve(const Facelets& facelets, const SolveOptions& options, const ImprovementCallback& onImproved = ImprovementCallback()) const {
+		std::array<uint8_t, Cube222::CornerCount> cp;
+		std::array<uint8_t, Cube222::CornerCount> co;
+		SolveResult result;
+		TRACE_SPAN("solver", "two-phase");
+		if (!Cube222::cornersFromFacelets(facelets, cp, co) || cp[FixedCorner] != FixedCorner || co[FixedCorner] != 0) {
+			result.status = INVALID_STATE;
+			return result;
+		}
+
+		Search search(options, onImproved, result);
+		search.metric = options.metric;
+		search.bestLength = options.maxDepth > 0 ? options.maxDepth + 1 : MaxLength;
+		const uint16_t twist = (uint16_t)Lehmer::rankOrientation(co, 3);
+		const uint16_t perm = (uint16_t)Lehmer::rankPermutation(cp);
+
+		// No ply goes past MaxLength, so the per ply counters never grow inside the node loop
+		search.budget.stats.plies.reserve(MaxLength);
+		for (int depth = 0; depth < search.bestLength && !search.budget.stopped; ++depth) {
+			TRACE_SPAN_VALUE("solver", "phase 1 depth", depth);
+			const uint64_t nodesBefore = search.budget.nodes;
+			const double secondsBefore = search.budget.elapsed();
+			{
+				AllocAudit::Scope audit;
+				phase1(search, twist, perm, depth, 0);
+				search.budget.stats.allocations += audit.allocations();
+			}
+			search.budget.endIteration(depth, nodesBefore, secondsBefore);
+		}
+
+		result.nodes = search.budget.nodes;
+		result.seconds = search.budget.elapsed();
+		result.stats = search.budget.finishStats();
+		if (result.solution.empty() && search.bestLength > 0) {
+			result.status = search.budget.stopped ? search.budget.status : DEPTH_LIMIT;
+		}
+		else {
+			result.status = SOLVED;
+			result.optimal = !search.budget.stopped;
+		}
+		return result;
+	}
+
+private:
+	static constexpr int FixedCorner = 6;
+	static constexpr int TwistCount = 2187;
+	static constexpr int PermutationCount = 40320;
+	static constexpr int MaxLength = 64;
+	static constexpr uint8_t Unreached = 0xFF;
+
+	// Phase 1 moves, the half turns only in the half turn metric
+	static constexpr int MoveCount = 9;
+	static constexpr int QuarterTurnCount = 6;
+	static constexpr std::array<Rotation, MoveCount> phase1Moves = { U, R, F, UI, RI, FI, U2, R2, F2 };
+
+	// Phase 2 moves as indices in phase1Moves
+	static constexpr int Phase2MoveCount = 5;
+	static constexpr std::array<int, Phase2MoveCount> phase2Moves = { 0, 3, 6, 7, 8 };
+
+	std::array<std::array<uint16_t, MoveCount>, TwistCount> _twistMove;
+	std::array<std::array<uint16_t, MoveCount>, PermutationCount> _permMove;
+	std::array<std::array<uint8_t, TwistCount>, 2> _twistDistance;          // Indexed by Metric
+	std::array<std::array<uint8_t, PermutationCount>, 2> _permDistance;     // Indexed by Metric
+
+	/// <summary>
+	/// State of one solve call
+	/// </summary>
+	struct Search {
+		SearchBudget budget;
+		const ImprovementCallback& onImproved;
+		SolveResult& result;
+		Metric metric = QUARTER_TURN;
+		int bestLength = MaxLength;
+		std::array<Rotation, MaxLength> phase1Path;
+		std::array<int, MaxLength> phase2Path;
+
+		Search(const SolveOptions& options, const ImprovementCallback& callback, SolveResult& best)
+			: budget(options), onImproved(callback), result(best) {
+		}
+	};
+
+	/// <summary>
+	/// Build the cubie level move tables from the facelet moves, then the distance tables of both phases
+	/// </summary>
+	TwoPhaseSolver() {
+		TRACE_SPAN("tables", "two-phase tables");
+		const Facelets solved = Cube222().getFacelets();
+		std::array<std::array<uint8_t, Cube222::CornerCount>, MoveCount> moveCp;
+		std::array<std::array<uint8_t, Cube222::CornerCount>, MoveCount> moveCo;
+		for (int m = 0; m < MoveCount; ++m) {
+			Cube222::cornersFromFacelets(Cube222::permute(solved, Cube222::moveFacelets[phase1Moves[m]]), moveCp[m], moveCo[m]);
+		}
+
+		for (int t = 0; t < TwistCount; ++t) {
+			std::array<uint8_t, Cube222::CornerCount> co;
+			Lehmer::unrankOrientation(t, 3, co);
+			for (int m = 0; m < MoveCount; ++m) {
+				std::array<uint8_t, Cube222::CornerCount> moved;
+				for (int i = 0; i < Cube222::CornerCount; ++i) {
+					moved[i] = (uint8_t)((co[moveCp[m][i]] + moveCo[m][i]) % 3);
+				}
+				_twistMove[t][m] = (uint16_t)Lehmer::rankOrientation(moved, 3);
+			}
+		}
+		for (int p = 0; p < PermutationCount; ++p) {
+			std::array<uint8_t, Cube222::CornerCount> cp;
+			Lehmer::unrankPermutation(p, cp);
+			for (int m = 0; m < MoveCount; ++m) {
+				std::array<uint8_t, Cube222::CornerCount> moved;
+				for (int i = 0; i < Cube222::CornerCount; ++i) {
+					moved[i] = cp[moveCp[m][i]];
+				}
+				_permMove[p][m] = (uint16_t)Lehmer::rankPermutation(moved);
+			}
+		}
+
+		for (Metric metric : { QUARTER_TURN, HALF_TURN }) {
+			buildTwistDistance(metric);
+			buildPermutationDistance(metric);
+		}
+	}
+
+	/// <summary>
+	/// Cost of a move in a metric
+	/// </summary>
+	static int moveCost(int m, Metric metric) {
+		return metric == QUARTER_TURN && phase1Moves[m] >= U2 ? 2 : 1;
+	}
+
+	/// <summary>
+	/// Phase 1 moves of a metric, the quarter turn metric leaves out the half turns
+	/// </summary>
+	static int phase1MoveCount(Metric metric) {
+		return metric == HALF_TURN ? MoveCount : QuarterTurnCount;
+	}
+
+	/// <summary>
+	/// Phase 1: breadth first over the twists
+	/// </summary>
+	void buildTwistDistance(Metric metric) {
+		auto& distance = _twistDistance[metric];
+		distance.fill(Unreached);
+		distance[0] = 0;
+		for (int depth = 0, found = 1; found > 0; ++depth) {
+			found = 0;
+			for (int t = 0; t < TwistCount; ++t) {
+				if (distance[t] != depth) {
+					continue;
+				}
+				for (int m = 0; m < phase1MoveCount(metric); ++m) {
+					if (distance[_twistMove[t][m]] == Unreached) {
+						distance[_twistMove[t][m]] = (uint8_t)(depth + 1);
+						++found;
+					}
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// Phase 2: cost of the cheapest sequence of phase 2 moves that solves each permutation.
+	/// Costs are 1 or 2, so the states are settled one cost level at a time.
+	/// </summary>
+	void buildPermutationDistance(Metric metric) {
+		auto& distance = _permDistance[metric];
+		distance.fill(Unreached);
+		distance[0] = 0;
+		for (int cost = 0, pending = 1; pending > 0; ++cost) {
+			pending = 0;
+			for (int p = 0; p < PermutationCount; ++p) {
+				if (distance[p] == Unreached || distance[p] < cost) {
+					continue;
+				}
+				if (distance[p] > cost) {
+					++pending;
+					continue;
+				}
+				for (int m : phase2Moves) {
+					const uint16_t next = _permMove[p][m];
+					if (distance[next] > cost + moveCost(m, metric)) {
+						distance[next] = (uint8_t)(cost + moveCost(m, metric));
+						++pending;
+					}
+				}
+			}
+		}
+	}
+
+	/// <summary>
+	/// Whether a move may follow another: a move never undoes the previous one, and in the half turn
+	/// metric (or in phase 2, where U2 exists) two turns of the same face are never in a row
+	/// </summary>
+	static bool canFollow(Rotation move, Rotation last, bool sameFaceAllowed) {
+		return move != inverseRotation(last) && (sameFaceAllowed || rotationFace(move) != rotationFace(last));
+	}
+
+	/// <summary>
+	/// Whether a move belongs to phase 2
+	/// </summary>
+	static bool isPhase2Move(Rotation move) {
+		for (int m : phase2Moves) {
+			if (phase1Moves[m] == move) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Phase 1 sequences of exactly the given length that end with every corner twist solved.
+	/// A sequence ending in a phase 2 move is skipped, that move belongs to phase 2.
+	/// </summary>
+	void phase1(Search& search, uint16_t twist, uint16_t perm, int remaining, int depth) const {
+		search.budget.expand(depth);
+		if (!search.budget.withinBudget()) {
+			return;
+		}
+		if (remaining == 0) {
+			if (twist == 0 && (depth == 0 || !isPhase2Move(search.phase1Path[depth - 1]))) {
+				startPhase2(search, perm, depth);
+			}
+			return;
+		}
+		if (_twistDistance[search.metric][twist] > remaining) {
+			search.budget.cutoff(depth);
+			return;
+		}
+
+		for (int m = 0; m < phase1MoveCount(search.metric); ++m) {
+			if (depth > 0 && !canFollow(phase1Moves[m], search.phase1Path[depth - 1], search.metric == QUARTER_TURN)) {
+				search.budget.skip(depth);
+				continue;
+			}
+			search.phase1Path[depth] = phase1Moves[m];
+			phase1(search, _twistMove[twist][m], _permMove[perm][m], remaining - 1, depth + 1);
+			if (search.budget.stopped || depth + remaining >= search.bestLength) {
+				return;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Shortest phase 2 finish that beats the best solution, by iterative deepening on its cost
+	/// </summary>
+	void startPhase2(Search& search, uint16_t perm, int phase1Length) const {
+		const int bound = search.bestLength - 1 - phase1Length;
+		for (int cost = _permDistance[search.metric][perm]; cost <= bound; ++cost) {
+			if (phase2(search, perm, cost, phase1Length, 0)) {
+				return;
+			}
+			if (search.budget.stopped) {
+				return;
+			}
+		}
+	}
+
+	bool phase2(Search& search, uint16_t perm, int remaining, int phase1Length, int depth) const {
+		const int ply = phase1Length + depth;
+		search.budget.expand(ply);
+		if (perm == 0) {
+			publish(search, phase1Length, depth);
+			return true;
+		}
+		if (!search.budget.withinBudget()) {
+			return false;
+		}
+		if (_permDistance[search.metric][perm] > remaining) {
+			search.budget.cutoff(ply);
+			return false;
+		}
+
+		const bool hasLast = depth > 0 || phase1Length > 0;
+		const Rotation last = depth > 0 ? phase1Moves[search.phase2Path[depth - 1]] : (phase1Length > 0 ? search.phase1Path[phase1Length - 1] : U);
+		for (int m : phase2Moves) {
+			const int cost = moveCost(m, search.metric);
+			if (cost > remaining || (hasLast && !canFollow(phase1Moves[m], last, false))) {
+				search.budget.skip(ply);
+				continue;
+			}
+			search.phase2Path[depth] = m;
+			if (phase2(search, _permMove[perm][m], remaining - cost, phase1Length, depth + 1)) {
+				return true;
+			}
+			if (search.budget.stopped) {
+				return false;
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Record a shorter solution and hand it to the callback. The moves either side of the
+	/// phase boundary may cancel or merge, so the length is taken after simplifying.
+	/// </summary>
+	void publish(Search& search, int phase1Length, int phase2Length) const {
+		// Once per improvement, not per node
+		AllocAudit::Pause pause;
+		std::vector<Rotation> solution(search.phase1Path.begin(), search.phase1Path.begin() + phase1Length);
+		for (int i = 0; i < phase2Length; ++i) {
+			solution.push_back(phase1Moves[search.phase2Path[i]]);
+		}
+		solution = Cube::simplifySolution(solution);
+		const int length = Cube::solutionLength(solution, search.metric);
+		if (length >= search.bestLength) {
+			return;
+		}
+
+		search.bestLength = length;
+		search.result.status = SOLVED;
+		search.result.solution = solution;
+		search.result.nodes = search.budget.nodes;
+		search.result.seconds = search.budget.elapsed();
+		if (search.onImproved) {
+			search.onImproved(search.result);
+		}
+	}
+};